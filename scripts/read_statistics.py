@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+"""Reads statistics exported in Arrow IPC format and prints them as CSV.
+
+Usage: read_statistics.py <file.arrow>
+
+Requires pyarrow.
+"""
+
+import sys
+
+import pyarrow as pa
+
+COLUMNS = ["tick", "healthy", "sick", "recovered", "infected"]
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__.strip())
+    with pa.memory_map(sys.argv[1]) as source:
+        table = pa.ipc.open_file(source).read_all()
+    if table.column_names != COLUMNS:
+        sys.exit(f"unexpected columns: {table.column_names}")
+    print(",".join(COLUMNS))
+    for row in zip(*(table.column(name).to_pylist() for name in COLUMNS)):
+        print(",".join(map(str, row)))
+
+
+if __name__ == "__main__":
+    main()
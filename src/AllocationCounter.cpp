@@ -0,0 +1,92 @@
+#include "AllocationCounter.h"
+
+#include <cerrno>
+#include <cstddef>
+
+namespace {
+
+thread_local cvd::AllocationCounter *tCurrent = nullptr;
+
+} // namespace
+
+namespace cvd {
+
+AllocationCounter::Attach::Attach(AllocationCounter *const counter)
+    : previous_{tCurrent} {
+  tCurrent = counter;
+}
+
+AllocationCounter::Attach::~Attach() { tCurrent = previous_; }
+
+AllocationCounter::AllocationCounter() : previous_{tCurrent} {
+  tCurrent = this;
+}
+
+AllocationCounter::~AllocationCounter() { tCurrent = previous_; }
+
+AllocationCounter *AllocationCounter::current() { return tCurrent; }
+
+void countAllocation() {
+  if (tCurrent) {
+    tCurrent->count_.fetch_add(1u, std::memory_order_relaxed);
+  }
+}
+
+} // namespace cvd
+
+#ifdef CVD_COUNT_ALLOCATIONS
+//! The allocator of glibc behind its public names
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t number, std::size_t size);
+void *__libc_realloc(void *memory, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+}
+
+//! Defined in the executable, these win over the libc ones for every
+//! library as well, so Qt containers count just like operator new, which
+//! calls malloc. free stays with glibc, the memory is glibc's.
+extern "C" {
+
+void *malloc(const std::size_t size) {
+  cvd::countAllocation();
+  return __libc_malloc(size);
+}
+
+void *calloc(const std::size_t number, const std::size_t size) {
+  cvd::countAllocation();
+  return __libc_calloc(number, size);
+}
+
+void *realloc(void *const memory, const std::size_t size) {
+  cvd::countAllocation();
+  return __libc_realloc(memory, size);
+}
+
+void *memalign(const std::size_t alignment, const std::size_t size) {
+  cvd::countAllocation();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(const std::size_t alignment, const std::size_t size) {
+  cvd::countAllocation();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **const memory, const std::size_t alignment,
+                   const std::size_t size) {
+  if (alignment == 0u || alignment % sizeof(void *) != 0u ||
+      (alignment & (alignment - 1u)) != 0u) {
+    return EINVAL;
+  }
+  cvd::countAllocation();
+  auto *const aligned = __libc_memalign(alignment, size);
+  if (!aligned) {
+    return ENOMEM;
+  }
+  *memory = aligned;
+  return 0;
+}
+
+} // extern "C"
+#endif
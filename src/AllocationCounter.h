@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace cvd {
+
+//! Counts the heap allocations made while it exists, on the thread that
+//! created it and on threads attached to it, e.g. scheduler workers running
+//! chunks of a loop started under it. Counters nest, an allocation counts
+//! for the innermost one of its thread.
+//!
+//! Only counts in builds with CVD_COUNT_ALLOCATIONS, which replace malloc
+//! and its siblings with counting ones, the count stays zero otherwise.
+class AllocationCounter final {
+public:
+  //! Makes another thread count for a counter while it exists.
+  class Attach final {
+  public:
+    explicit Attach(AllocationCounter *counter);
+    ~Attach();
+
+    Attach(const Attach &) = delete;
+    Attach &operator=(const Attach &) = delete;
+
+  private:
+    AllocationCounter *previous_;
+  };
+
+public:
+  AllocationCounter();
+  ~AllocationCounter();
+
+  AllocationCounter(const AllocationCounter &) = delete;
+  AllocationCounter &operator=(const AllocationCounter &) = delete;
+
+  [[nodiscard]] uint64_t count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  //! The counter allocations of the calling thread count for, if any.
+  [[nodiscard]] static AllocationCounter *current();
+  [[nodiscard]] static constexpr bool enabled() {
+#ifdef CVD_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+private:
+  //! Called by the counting malloc
+  friend void countAllocation();
+
+  std::atomic<uint64_t> count_{0u};
+  AllocationCounter *previous_;
+};
+
+} // namespace cvd
@@ -0,0 +1,288 @@
+#include "Arrow.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN,
+              "Arrow buffers are written in host byte order");
+
+constexpr char gMagic[6] = {'A', 'R', 'R', 'O', 'W', '1'};
+constexpr uint32_t gContinuation = 0xFFFFFFFFu;
+constexpr int16_t gMetadataV5 = 4;
+constexpr uint8_t gHeaderSchema = 1u;
+constexpr uint8_t gHeaderRecordBatch = 3u;
+constexpr uint8_t gTypeInt = 2u;
+constexpr int32_t gBitWidth = 64;
+
+struct FieldNode final {
+  int64_t length;
+  int64_t nullCount;
+};
+
+struct Buffer final {
+  int64_t offset;
+  int64_t length;
+};
+
+static_assert(sizeof(cvd::arrow::Block) == 24u);
+static_assert(sizeof(FieldNode) == 16u && sizeof(Buffer) == 16u);
+
+//! Just enough of a flatbuffer builder for the Arrow metadata. Like the
+//! reference builder, objects are prepended, children before their parents,
+//! and referenced by their distance from the end of the buffer. Metadata is
+//! a few hundred bytes, so prepending to a vector is fine.
+class FlatBuilder final {
+public:
+  [[nodiscard]] uint32_t createString(const char *string) {
+    const auto length = std::strlen(string);
+    align(4u, length + 1u);
+    prepend("", 1u);
+    prepend(string, length);
+    add(static_cast<uint32_t>(length));
+    return size();
+  }
+
+  [[nodiscard]] uint32_t createOffsets(const std::vector<uint32_t> &offsets) {
+    align(4u, offsets.size() * sizeof(uint32_t));
+    for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+      addOffset(*it);
+    }
+    add(static_cast<uint32_t>(offsets.size()));
+    return size();
+  }
+
+  template <typename Struct>
+  [[nodiscard]] uint32_t createStructs(const std::vector<Struct> &structs) {
+    const auto bytes = structs.size() * sizeof(Struct);
+    align(4u, bytes);
+    align(alignof(Struct), bytes);
+    prepend(structs.data(), bytes);
+    add(static_cast<uint32_t>(structs.size()));
+    return size();
+  }
+
+  void startTable() {
+    assert(fields_.empty());
+    tableStart_ = size();
+  }
+
+  template <typename Scalar> void addField(uint16_t field, Scalar value) {
+    add(value);
+    fields_.emplace_back(field, size());
+  }
+
+  void addOffsetField(uint16_t field, uint32_t offset) {
+    addOffset(offset);
+    fields_.emplace_back(field, size());
+  }
+
+  [[nodiscard]] uint32_t endTable() {
+    //! Placeholder for the distance to the vtable
+    add(int32_t{0});
+    const auto table = size();
+
+    uint16_t count = 0u;
+    for (const auto &field : fields_) {
+      count = std::max<uint16_t>(count, field.first + 1u);
+    }
+    std::vector<uint16_t> vtable(count, 0u);
+    for (const auto &[field, end] : fields_) {
+      vtable[field] = static_cast<uint16_t>(table - end);
+    }
+    for (auto it = vtable.rbegin(); it != vtable.rend(); ++it) {
+      add(*it);
+    }
+    add(static_cast<uint16_t>(table - tableStart_));
+    add(static_cast<uint16_t>((count + 2u) * sizeof(uint16_t)));
+
+    const auto distance = static_cast<int32_t>(size() - table);
+    std::memcpy(buffer_.data() + buffer_.size() - table, &distance,
+                sizeof(distance));
+    fields_.clear();
+    return table;
+  }
+
+  [[nodiscard]] QByteArray finish(uint32_t root) {
+    align(minAlignment_, sizeof(uint32_t));
+    addOffset(root);
+    return QByteArray{reinterpret_cast<const char *>(buffer_.data()),
+                      static_cast<int>(buffer_.size())};
+  }
+
+private:
+  [[nodiscard]] uint32_t size() const {
+    return static_cast<uint32_t>(buffer_.size());
+  }
+
+  //! Pads so that the end of the next \p additional bytes is aligned.
+  void align(size_t alignment, size_t additional = 0u) {
+    minAlignment_ = std::max(minAlignment_, alignment);
+    const auto padding = (alignment - (size() + additional) % alignment) %
+                         alignment;
+    buffer_.insert(buffer_.begin(), padding, uint8_t{0});
+  }
+
+  void prepend(const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    buffer_.insert(buffer_.begin(), bytes, bytes + size);
+  }
+
+  template <typename Scalar> void add(Scalar value) {
+    align(sizeof(Scalar));
+    prepend(&value, sizeof(value));
+  }
+
+  void addOffset(uint32_t offset) {
+    align(sizeof(uint32_t));
+    assert(offset <= size());
+    add(size() + static_cast<uint32_t>(sizeof(uint32_t)) - offset);
+  }
+
+private:
+  std::vector<uint8_t> buffer_;
+  size_t minAlignment_ = 1u;
+  uint32_t tableStart_ = 0u;
+  std::vector<std::pair<uint16_t, uint32_t>> fields_;
+};
+
+[[nodiscard]] uint32_t createSchema(FlatBuilder &builder,
+                                    const cvd::arrow::Names &names) {
+  std::vector<uint32_t> fields;
+  for (const auto *name : names) {
+    const auto nameOffset = builder.createString(name);
+    builder.startTable();
+    builder.addField(0u, gBitWidth);
+    builder.addField(1u, uint8_t{false}); // is_signed
+    const auto type = builder.endTable();
+    const auto children = builder.createOffsets({});
+
+    builder.startTable();
+    builder.addOffsetField(0u, nameOffset);
+    builder.addField(1u, uint8_t{false}); // nullable
+    builder.addField(2u, gTypeInt);
+    builder.addOffsetField(3u, type);
+    builder.addOffsetField(5u, children);
+    fields.push_back(builder.endTable());
+  }
+  const auto fieldsOffset = builder.createOffsets(fields);
+
+  builder.startTable();
+  builder.addOffsetField(1u, fieldsOffset);
+  return builder.endTable();
+}
+
+[[nodiscard]] QByteArray createMessage(FlatBuilder &builder,
+                                       const uint8_t headerType,
+                                       const uint32_t header,
+                                       const int64_t bodyLength) {
+  builder.startTable();
+  builder.addField(3u, bodyLength);
+  builder.addOffsetField(2u, header);
+  builder.addField(0u, gMetadataV5);
+  builder.addField(1u, headerType);
+  return builder.finish(builder.endTable());
+}
+
+void appendPadding(QByteArray &out) {
+  while (out.size() % 8 != 0) {
+    out.append('\0');
+  }
+}
+
+//! Appends the continuation marker, the metadata size and the padded
+//! metadata, returns the size of all three.
+int32_t appendMetadata(const QByteArray &metadata, QByteArray &out) {
+  const auto start = out.size();
+  const auto padded = (metadata.size() + 7) / 8 * 8;
+  out.append(reinterpret_cast<const char *>(&gContinuation),
+             sizeof(gContinuation));
+  out.append(reinterpret_cast<const char *>(&padded), sizeof(padded));
+  out.append(metadata);
+  out.append(QByteArray(padded - metadata.size(), '\0'));
+  return static_cast<int32_t>(out.size() - start);
+}
+
+} // namespace
+
+namespace cvd::arrow {
+
+void appendFileStart(QByteArray &out) {
+  out.append(gMagic, sizeof(gMagic));
+  appendPadding(out);
+}
+
+void appendSchema(const Names &names, QByteArray &out) {
+  FlatBuilder builder;
+  const auto schema = createSchema(builder, names);
+  appendMetadata(createMessage(builder, gHeaderSchema, schema, 0), out);
+}
+
+Block appendRecordBatch(const Columns &columns, const int64_t offset,
+                        QByteArray &out) {
+  assert(!columns.empty());
+  const auto length = static_cast<int64_t>(columns.front().size());
+
+  //! Validity bitmaps are omitted, every column has no nulls
+  std::vector<FieldNode> nodes;
+  std::vector<Buffer> buffers;
+  auto bodyLength = int64_t{0};
+  for (const auto &column : columns) {
+    assert(static_cast<int64_t>(column.size()) == length);
+    nodes.push_back(FieldNode{length, 0});
+    buffers.push_back(Buffer{bodyLength, 0});
+    const auto bytes = static_cast<int64_t>(column.size() * sizeof(uint64_t));
+    buffers.push_back(Buffer{bodyLength, bytes});
+    bodyLength += bytes;
+  }
+
+  FlatBuilder builder;
+  const auto nodesOffset = builder.createStructs(nodes);
+  const auto buffersOffset = builder.createStructs(buffers);
+  builder.startTable();
+  builder.addField(0u, length);
+  builder.addOffsetField(1u, nodesOffset);
+  builder.addOffsetField(2u, buffersOffset);
+  const auto batch = builder.endTable();
+
+  const auto metaDataLength = appendMetadata(
+      createMessage(builder, gHeaderRecordBatch, batch, bodyLength), out);
+  for (const auto &column : columns) {
+    out.append(reinterpret_cast<const char *>(column.data()),
+               static_cast<int>(column.size() * sizeof(uint64_t)));
+  }
+  return Block{offset, metaDataLength, 0, bodyLength};
+}
+
+void appendFooter(const Names &names, const std::vector<Block> &blocks,
+                  QByteArray &out) {
+  //! End of stream marker, then the footer
+  const auto endOfStream = uint32_t{0u};
+  out.append(reinterpret_cast<const char *>(&gContinuation),
+             sizeof(gContinuation));
+  out.append(reinterpret_cast<const char *>(&endOfStream),
+             sizeof(endOfStream));
+
+  FlatBuilder builder;
+  const auto schema = createSchema(builder, names);
+  const auto dictionaries = builder.createStructs(std::vector<Block>{});
+  const auto recordBatches = builder.createStructs(blocks);
+  builder.startTable();
+  builder.addOffsetField(1u, schema);
+  builder.addOffsetField(2u, dictionaries);
+  builder.addOffsetField(3u, recordBatches);
+  builder.addField(0u, gMetadataV5);
+  const auto footer = builder.finish(builder.endTable());
+
+  const auto footerSize = static_cast<int32_t>(footer.size());
+  out.append(footer);
+  out.append(reinterpret_cast<const char *>(&footerSize), sizeof(footerSize));
+  out.append(gMagic, sizeof(gMagic));
+}
+
+} // namespace cvd::arrow
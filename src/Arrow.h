@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QByteArray>
+
+#include <cstdint>
+#include <vector>
+
+namespace cvd {
+
+//! Writer side of the Arrow IPC file format (columnar format 1.0, metadata
+//! version 5), limited to tables of non-nullable unsigned 64 bit columns.
+//!
+//! File start, schema message, one message per record batch, then the
+//! footer repeating the schema and locating every record batch. Messages
+//! are a flatbuffer with the metadata followed by the column buffers, all
+//! padded to 8 bytes.
+namespace arrow {
+
+using Names = std::vector<const char *>;
+using Columns = std::vector<std::vector<uint64_t>>;
+
+//! Location of a record batch, as stored in the footer.
+struct Block final {
+  int64_t offset;
+  int32_t metaDataLength;
+  int32_t padding;
+  int64_t bodyLength;
+};
+
+void appendFileStart(QByteArray &out);
+void appendSchema(const Names &names, QByteArray &out);
+//! Appends a record batch of equally long \p columns. \p offset is the
+//! file position the message is going to be written at.
+[[nodiscard]] Block appendRecordBatch(const Columns &columns, int64_t offset,
+                                      QByteArray &out);
+void appendFooter(const Names &names, const std::vector<Block> &blocks,
+                  QByteArray &out);
+
+} // namespace arrow
+
+} // namespace cvd
@@ -0,0 +1,273 @@
+#include "Checkpoint.h"
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+constexpr char gMagic[8] = {'C', 'V', 'D', 'C', 'K', 'P', 'T', '\0'};
+constexpr uint32_t gVersion = 1u;
+constexpr int gChunkSize = 1 << 20;
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN,
+              "Checkpoint records are stored in host byte order");
+
+struct Header final {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t number;
+  float sickPercentage;
+  float radius;
+  float sickTime;
+  float minimalSpeed;
+  float freezePercentage;
+  uint8_t collisions;
+  uint8_t fixedPoint;
+  uint8_t poissonDisk;
+  uint8_t superspreaders;
+  int32_t bounds[4];
+  uint64_t ticks;
+  uint64_t historySize;
+  uint64_t subjectsSize;
+};
+
+struct HistoryRecord final {
+  uint64_t healthy;
+  uint64_t sick;
+  uint64_t recovered;
+  uint64_t infected;
+};
+
+struct SubjectRecord final {
+  double x;
+  double y;
+  float directionX;
+  float directionY;
+  float speed;
+  float radius;
+  float sickTimeRemaining;
+  uint8_t status;
+  uint8_t freezed;
+  uint16_t padding;
+};
+
+static_assert(sizeof(Header) == 88u);
+static_assert(sizeof(HistoryRecord) == 32u);
+static_assert(sizeof(SubjectRecord) == 40u);
+
+//! Appends records to the file through a fixed size chunk, so a save does
+//! not hold a second copy of the whole population in memory.
+class ChunkWriter final {
+public:
+  explicit ChunkWriter(QIODevice &device) : device_{device} {
+    buffer_.reserve(gChunkSize);
+  }
+
+  template <typename T> void append(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buffer_.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    if (buffer_.size() >= gChunkSize) {
+      flush();
+    }
+  }
+
+  bool flush() {
+    ok_ = ok_ && device_.write(buffer_) == buffer_.size();
+    buffer_.resize(0);
+    return ok_;
+  }
+
+private:
+  QIODevice &device_;
+  QByteArray buffer_;
+  bool ok_ = true;
+};
+
+template <typename T> T load(const uchar *data) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+//! Also false for NaN
+[[nodiscard]] bool nonNegative(const float value) {
+  return std::isfinite(value) && value >= 0.f;
+}
+
+[[nodiscard]] bool fraction(const float value) {
+  return nonNegative(value) && value <= 1.f;
+}
+
+//! Also false for NaN
+[[nodiscard]] bool positive(const float value) {
+  return std::isfinite(value) && value > 0.f;
+}
+
+//! Rejects what a simulation could not run on, e.g. a corrupted file that
+//! still has consistent sizes
+[[nodiscard]] bool isValid(const Header &header) {
+  return header.number == header.subjectsSize &&
+         fraction(header.sickPercentage) && nonNegative(header.radius) &&
+         positive(header.sickTime) && positive(header.minimalSpeed) &&
+         fraction(header.freezePercentage) && header.bounds[2] > 0 &&
+         header.bounds[3] > 0;
+}
+
+[[nodiscard]] bool isValid(const SubjectRecord &record) {
+  using Status = cvd::Subject::Status;
+  //! Sick subjects are scheduled to recover after the time left
+  const auto sick = record.status == static_cast<uint8_t>(Status::Sick);
+  return std::isfinite(record.x) && std::isfinite(record.y) &&
+         std::isfinite(record.directionX) &&
+         std::isfinite(record.directionY) && nonNegative(record.speed) &&
+         nonNegative(record.radius) &&
+         std::isfinite(record.sickTimeRemaining) &&
+         (!sick || nonNegative(record.sickTimeRemaining)) &&
+         record.status <= static_cast<uint8_t>(Status::Recovered);
+}
+
+} // namespace
+
+namespace cvd {
+
+bool writeCheckpoint(const QString &path, const Checkpoint &checkpoint) {
+  const auto &params = checkpoint.params;
+  const auto &bounds = checkpoint.bounds;
+  Header header{};
+  std::memcpy(header.magic, gMagic, sizeof(gMagic));
+  header.version = gVersion;
+  header.number = params.number;
+  header.sickPercentage = params.sickPercentage;
+  header.radius = params.radius;
+  header.sickTime = params.sickTime;
+  header.minimalSpeed = params.minimalSpeed;
+  header.freezePercentage = params.freezePercentage;
+  header.collisions = params.collisions ? 1u : 0u;
+  header.fixedPoint = params.fixedPoint ? 1u : 0u;
+  header.poissonDisk = params.poissonDisk ? 1u : 0u;
+  header.superspreaders = params.superspreaders ? 1u : 0u;
+  header.bounds[0] = bounds.x();
+  header.bounds[1] = bounds.y();
+  header.bounds[2] = bounds.width();
+  header.bounds[3] = bounds.height();
+  header.ticks = checkpoint.ticks;
+  header.historySize = checkpoint.history.size();
+  header.subjectsSize = checkpoint.subjects.size();
+
+  //! Written aside and renamed, an interrupted save keeps the previous file
+  QSaveFile file{path};
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+
+  ChunkWriter writer{file};
+  writer.append(header);
+  for (const auto &statistics : checkpoint.history) {
+    writer.append(HistoryRecord{statistics.healthy, statistics.sick,
+                                statistics.recovered, statistics.infected});
+  }
+  for (const auto &subject : checkpoint.subjects) {
+    writer.append(SubjectRecord{
+        subject.pos.x(),
+        subject.pos.y(),
+        subject.direction.x(),
+        subject.direction.y(),
+        subject.speed,
+        subject.radius,
+        subject.sickTimeRemaining,
+        static_cast<uint8_t>(subject.status),
+        static_cast<uint8_t>(subject.freezed ? 1u : 0u),
+        0u,
+    });
+  }
+
+  if (!writer.flush()) {
+    file.cancelWriting();
+    return false;
+  }
+  return file.commit();
+}
+
+std::optional<Checkpoint> readCheckpoint(const QString &path) {
+  QFile file{path};
+  if (!file.open(QIODevice::ReadOnly) ||
+      file.size() < static_cast<qint64>(sizeof(Header))) {
+    return std::nullopt;
+  }
+  const auto *const data = file.map(0, file.size());
+  if (!data) {
+    return std::nullopt;
+  }
+
+  const auto header = load<Header>(data);
+  const auto fileSize = static_cast<uint64_t>(file.size());
+  if (std::memcmp(header.magic, gMagic, sizeof(gMagic)) != 0 ||
+      header.version != gVersion || !isValid(header) ||
+      header.historySize > fileSize / sizeof(HistoryRecord) ||
+      header.subjectsSize > fileSize / sizeof(SubjectRecord) ||
+      fileSize != sizeof(Header) +
+                      header.historySize * sizeof(HistoryRecord) +
+                      header.subjectsSize * sizeof(SubjectRecord)) {
+    return std::nullopt;
+  }
+
+  Checkpoint checkpoint{
+      Params{
+          static_cast<size_t>(header.number),
+          header.sickPercentage,
+          header.radius,
+          header.sickTime,
+          header.minimalSpeed,
+          header.freezePercentage,
+          header.collisions != 0u,
+          header.fixedPoint != 0u,
+          header.poissonDisk != 0u,
+          header.superspreaders != 0u,
+      },
+      QRect{header.bounds[0], header.bounds[1], header.bounds[2],
+            header.bounds[3]},
+      header.ticks,
+      {},
+      {},
+  };
+
+  auto offset = sizeof(Header);
+  checkpoint.history.reserve(header.historySize);
+  for (auto i = uint64_t{0}; i < header.historySize; ++i) {
+    const auto record = load<HistoryRecord>(data + offset);
+    offset += sizeof(HistoryRecord);
+    checkpoint.history.push_back(Statistics{
+        static_cast<size_t>(record.healthy),
+        static_cast<size_t>(record.sick),
+        static_cast<size_t>(record.recovered),
+        static_cast<size_t>(record.infected),
+    });
+  }
+
+  checkpoint.subjects.reserve(header.subjectsSize);
+  for (auto i = uint64_t{0}; i < header.subjectsSize; ++i) {
+    const auto record = load<SubjectRecord>(data + offset);
+    offset += sizeof(SubjectRecord);
+    if (!isValid(record)) {
+      return std::nullopt;
+    }
+    checkpoint.subjects.push_back(Subject{
+        QPointF{record.x, record.y},
+        QVector2D{record.directionX, record.directionY},
+        record.speed,
+        record.radius,
+        static_cast<Subject::Status>(record.status),
+        record.sickTimeRemaining,
+        record.freezed != 0u,
+    });
+  }
+  return checkpoint;
+}
+
+} // namespace cvd
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QRect>
+#include <QString>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "Params.h"
+#include "Statistics.h"
+#include "Subject.h"
+
+namespace cvd {
+
+//! Everything needed to continue a run in another process. Subjects are
+//! stored with their sick time synchronized, recovery timers are rebuilt
+//! from it on restore.
+struct Checkpoint final {
+  Params params;
+  QRect bounds;
+  uint64_t ticks;
+  std::vector<Statistics> history;
+  Subjects subjects;
+};
+
+//! Binary little endian format: a versioned header followed by fixed size
+//! history and subject records, so reading is a single pass over the
+//! memory mapped file. Reading rejects files with inconsistent sizes and
+//! non-finite or out of range params, bounds and subjects.
+[[nodiscard]] bool writeCheckpoint(const QString &path,
+                                   const Checkpoint &checkpoint);
+[[nodiscard]] std::optional<Checkpoint> readCheckpoint(const QString &path);
+
+} // namespace cvd
@@ -0,0 +1,125 @@
+#include "CompactSubjects.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr auto gStatusBits = 2u;
+constexpr auto gStatusMask = (1u << gStatusBits) - 1u;
+constexpr auto gFrozenBit = 1u << gStatusBits;
+constexpr auto gRadiusShift = gStatusBits + 1u;
+constexpr auto gRadiusBits = 12u;
+constexpr auto gRadiusMax = (1u << gRadiusBits) - 1u;
+constexpr auto gTimerShift = gRadiusShift + gRadiusBits;
+constexpr auto gTimerMax = (1u << (32u - gTimerShift)) - 1u;
+constexpr auto gPi = 3.14159265358979323846;
+constexpr auto gAngleUnits = 65536.;
+constexpr auto gPositionUnits = 4294967296.;
+
+//! A population on a line or a point leaves no extent, every position
+//! packs to the origin then
+[[nodiscard]] uint32_t quantize(const double value, const double origin,
+                                const double extent) {
+  if (!(extent > 0.)) {
+    return 0u;
+  }
+  const auto units = std::round((value - origin) / extent * gPositionUnits);
+  return static_cast<uint32_t>(std::clamp(
+      units, 0., static_cast<double>(std::numeric_limits<uint32_t>::max())));
+}
+
+[[nodiscard]] double dequantize(const uint32_t value, const double origin,
+                                const double extent) {
+  if (!(extent > 0.)) {
+    return origin;
+  }
+  return origin + static_cast<double>(value) / gPositionUnits * extent;
+}
+
+//! Maps [0, max] onto [0, units], anything else to the closest end
+[[nodiscard]] uint32_t encode(const float value, const float max,
+                              const uint32_t units) {
+  if (!(max > 0.f) || !(value > 0.f)) {
+    return 0u;
+  }
+  const auto scaled = std::round(static_cast<double>(value) / max * units);
+  return static_cast<uint32_t>(std::min(scaled, static_cast<double>(units)));
+}
+
+} // namespace
+
+namespace cvd {
+
+void CompactSubjects::assign(const Subjects &subjects) {
+  auto left = std::numeric_limits<double>::infinity();
+  auto top = left;
+  auto right = -left;
+  auto bottom = -left;
+  maxRadius_ = 0.f;
+  maxSpeed_ = 0.f;
+  for (const auto &subject : subjects) {
+    left = std::min(left, subject.pos.x());
+    top = std::min(top, subject.pos.y());
+    right = std::max(right, subject.pos.x());
+    bottom = std::max(bottom, subject.pos.y());
+    maxRadius_ = std::max(maxRadius_, subject.radius);
+    maxSpeed_ = std::max(maxSpeed_, subject.speed);
+  }
+  bounds_ = subjects.empty() ? QRectF{}
+                             : QRectF{QPointF{left, top},
+                                      QPointF{right, bottom}};
+
+  //! Keeps the capacity of the previous population
+  subjects_.clear();
+  subjects_.reserve(subjects.size());
+  for (const auto &subject : subjects) {
+    const auto angle = std::atan2(subject.direction.y(), subject.direction.x());
+    //! Wraps negative angles around through the unsigned conversion
+    const auto encodedAngle = static_cast<uint16_t>(static_cast<int32_t>(
+        std::lround(angle / (2. * gPi) * gAngleUnits)));
+
+    auto state = static_cast<uint32_t>(subject.status);
+    if (subject.freezed) {
+      state |= gFrozenBit;
+    }
+    state |= encode(subject.radius, maxRadius_, gRadiusMax) << gRadiusShift;
+    if (subject.status == Subject::Status::Sick) {
+      const auto time = std::round(
+          std::clamp(subject.sickTimeRemaining, 0.f,
+                     static_cast<float>(gTimerMax)));
+      state |= static_cast<uint32_t>(time) << gTimerShift;
+    }
+
+    subjects_.push_back(CompactSubject{
+        quantize(subject.pos.x(), bounds_.left(), bounds_.width()),
+        quantize(subject.pos.y(), bounds_.top(), bounds_.height()),
+        encodedAngle,
+        static_cast<uint16_t>(
+            encode(subject.speed, maxSpeed_,
+                   std::numeric_limits<uint16_t>::max())),
+        state,
+    });
+  }
+}
+
+QPointF CompactSubjects::pos(const size_t index) const {
+  const auto &subject = subjects_[index];
+  return QPointF{
+      dequantize(subject.x, bounds_.left(), bounds_.width()),
+      dequantize(subject.y, bounds_.top(), bounds_.height()),
+  };
+}
+
+float CompactSubjects::radius(const size_t index) const {
+  const auto units = (subjects_[index].state >> gRadiusShift) & gRadiusMax;
+  return static_cast<float>(units) / static_cast<float>(gRadiusMax) *
+         maxRadius_;
+}
+
+Subject::Status CompactSubjects::status(const size_t index) const {
+  return static_cast<Subject::Status>(subjects_[index].state & gStatusMask);
+}
+
+} // namespace cvd
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QRectF>
+
+#include <cstdint>
+#include <vector>
+
+#include "Subject.h"
+
+namespace cvd {
+
+//! Subject packed into 16 bytes. Position is quantized to the bounding box
+//! of the population, direction is stored as an angle, speed relative to
+//! the fastest subject and radius relative to the largest one.
+struct CompactSubject final {
+  uint32_t x;
+  uint32_t y;
+  uint16_t angle;
+  uint16_t speed;
+  //! Status, frozen flag, radius and rounded sick time left packed together
+  uint32_t state;
+};
+
+static_assert(sizeof(CompactSubject) == 16u, "CompactSubject must stay packed");
+
+//! Packed copy of subjects for painting, about three times smaller than
+//! Subjects. Packing is lossy within the quantization steps. Only
+//! snapshots are packed, the simulation keeps running on Subjects and its
+//! own per subject state, so its memory does not shrink.
+//!
+//! Sick time left is packed as the subjects carry it, the simulation only
+//! writes it back on Simulation::syncSickTime().
+class CompactSubjects final {
+public:
+  //! Packs \p subjects, reusing the storage of the previous ones.
+  void assign(const Subjects &subjects);
+
+  //! What painting needs of the subject at \p index, without unpacking the
+  //! rest of it.
+  [[nodiscard]] QPointF pos(size_t index) const;
+  [[nodiscard]] float radius(size_t index) const;
+  [[nodiscard]] Subject::Status status(size_t index) const;
+
+  [[nodiscard]] size_t size() const { return subjects_.size(); }
+  [[nodiscard]] const std::vector<CompactSubject> &data() const {
+    return subjects_;
+  }
+  [[nodiscard]] size_t memoryUsage() const {
+    return subjects_.capacity() * sizeof(CompactSubject);
+  }
+
+private:
+  QRectF bounds_;
+  float maxRadius_ = 0.f;
+  float maxSpeed_ = 0.f;
+  std::vector<CompactSubject> subjects_;
+};
+
+} // namespace cvd
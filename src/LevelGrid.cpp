@@ -0,0 +1,56 @@
+#include "LevelGrid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+namespace {
+
+//! Keeps the finest cells positive for subjects without reach
+constexpr auto gMinimalCellSize = 1.f;
+
+} // namespace
+
+namespace cvd {
+
+void LevelGrid::rebuild(const size_t first, const size_t last,
+                        const QRect &bounds, const std::vector<float> &reach) {
+  assert(first <= last && last <= positions_.size());
+  assert(reach.size() >= last);
+  for (auto &level : levels_) {
+    level.members.clear();
+  }
+  if (first == last) {
+    return;
+  }
+
+  auto finest = *std::min_element(
+      reach.begin() + static_cast<ptrdiff_t>(first),
+      reach.begin() + static_cast<ptrdiff_t>(last));
+  finest = std::max(finest, gMinimalCellSize);
+
+  for (auto id = first; id < last; ++id) {
+    auto level = 0u;
+    for (auto cellSize = finest; cellSize < reach[id]; cellSize *= 2.f) {
+      ++level;
+    }
+    if (level >= levels_.size()) {
+      levels_.resize(level + 1u);
+    }
+    levels_[level].members.push_back(static_cast<uint32_t>(id));
+  }
+
+  auto cellSize = finest;
+  for (auto &level : levels_) {
+    //! Subjects move between levels as their reach changes, room for all
+    //! of them keeps a level from growing whenever it peaks
+    level.members.reserve(last - first);
+    level.grid.reserve(last - first);
+    if (!level.members.empty()) {
+      level.grid.rebuild(positions_, level.members, bounds, cellSize);
+    }
+    cellSize *= 2.f;
+  }
+}
+
+} // namespace cvd
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QRect>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "SpatialGrid.h"
+
+namespace cvd {
+
+//! Uniform grids with cell sizes doubling from level to level, for subjects
+//! of very different radii. The reach of a subject is the farthest it can
+//! be from a subject of the same reach it may meet, e.g. its diameter plus
+//! a skin. Each subject is indexed at the finest level whose cells are at
+//! least its reach, so a few large subjects do not coarsen the cells of all
+//! the small ones.
+class LevelGrid final {
+public:
+  //! Indexes subjects from the [first, last) range, \p position maps an
+  //! index to the subject's position and \p reach is indexed like them.
+  template <typename Position>
+  void rebuild(Position &&position, size_t first, size_t last,
+               const QRect &bounds, const std::vector<float> &reach);
+
+  //! Visits every unordered pair of indexed subjects which may be within
+  //! reach of each other exactly once. Pairs on the same level come from
+  //! its half-shell stencil, a subject meets coarser levels through their
+  //! 3x3 neighbourhood, as their cells cover both reaches.
+  template <typename Visitor> void forEachPair(Visitor &&visitor) const;
+
+  //! Visits every indexed subject which may be within \p reach of \p pos,
+  //! or within its own reach.
+  template <typename Visitor>
+  void forEachNear(const QPointF &pos, float reach, Visitor &&visitor) const;
+
+private:
+  struct Level final {
+    std::vector<uint32_t> members;
+    SpatialGrid grid;
+  };
+
+private:
+  void rebuild(size_t first, size_t last, const QRect &bounds,
+               const std::vector<float> &reach);
+
+private:
+  //! Positions of the indexed subjects by index, copied once per rebuild
+  std::vector<QPointF> positions_;
+  std::vector<Level> levels_;
+};
+
+template <typename Position>
+void LevelGrid::rebuild(Position &&position, const size_t first,
+                        const size_t last, const QRect &bounds,
+                        const std::vector<float> &reach) {
+  positions_.resize(last);
+  for (auto id = first; id < last; ++id) {
+    positions_[id] = position(static_cast<uint32_t>(id));
+  }
+  rebuild(first, last, bounds, reach);
+}
+
+template <typename Visitor>
+void LevelGrid::forEachPair(Visitor &&visitor) const {
+  for (auto level = 0u; level < levels_.size(); ++level) {
+    if (levels_[level].members.empty()) {
+      continue;
+    }
+    levels_[level].grid.forEachPair(visitor);
+    for (const auto id : levels_[level].members) {
+      const auto &pos = positions_[id];
+      for (auto coarser = level + 1u; coarser < levels_.size(); ++coarser) {
+        if (!levels_[coarser].members.empty()) {
+          levels_[coarser].grid.forEachNear(
+              pos,
+              [&visitor, id](const uint32_t other) { visitor(id, other); });
+        }
+      }
+    }
+  }
+}
+
+template <typename Visitor>
+void LevelGrid::forEachNear(const QPointF &pos, const float reach,
+                            Visitor &&visitor) const {
+  for (const auto &level : levels_) {
+    if (!level.members.empty()) {
+      //! Finer levels are searched as far as the larger reach
+      const auto distance = std::max(reach, level.grid.cellSize());
+      level.grid.forEachWithin(pos, distance, visitor);
+    }
+  }
+}
+
+} // namespace cvd
@@ -1,8 +1,23 @@
 #include "MainWindow.h"
 
+#include <QFileDialog>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QSignalBlocker>
+#include <QThread>
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <optional>
 #include <random>
 
+#include "Checkpoint.h"
+#include "PoissonDisk.h"
+#include "VideoExporter.h"
+
 namespace {
 
 [[nodiscard]] auto generateRandomSpeed(const QRect &boundingBox,
@@ -40,24 +55,102 @@ namespace {
       .normalized();
 }
 
-constexpr auto gDeltaT = 1.f;
+//! Pareto shape of superspreader radii, small enough for a heavy tail
+constexpr auto gRadiusTail = 2.f;
+//! Superspreaders reach at most that many times the radius
+constexpr auto gMaxRadiusFactor = 16.f;
+
+[[nodiscard]] auto generateRandomRadius(const float radius) {
+  std::random_device randomDevice;
+  std::mt19937 generator(randomDevice());
+  //! Inverse transform sampling of the Pareto distribution, 1 - u keeps
+  //! zero out
+  std::uniform_real_distribution<float> dist(0.f, 1.f);
+  const auto factor = std::pow(1.f - dist(generator), -1.f / gRadiusTail);
+  return radius * std::min(factor, gMaxRadiusFactor);
+}
+
+//! Poisson-disk positions are spread out further than the radius demands,
+//! the maximal set then holds about a quarter more than asked for
+constexpr auto gPoissonSpread = 0.75;
+
+[[nodiscard]] auto
+generatePoissonPositions(const cvd::Params &params, const QRect &boundingBox,
+                         const cvd::Regenerator::Cancelled &cancelled,
+                         const cvd::Subjects *avoided) {
+  assert(boundingBox.width() == boundingBox.height());
+  //! The square generateRandomPosition samples from, kept clear of the
+  //! edges by the radius
+  const auto side = static_cast<double>(boundingBox.height());
+  const auto radius = static_cast<double>(params.radius);
+  const QRectF area{radius, radius, side - 2. * radius, side - 2. * radius};
+  const auto total = params.number + (avoided ? avoided->size() : 0u);
+  const auto perSubject = area.width() * area.height() /
+                          static_cast<double>(std::max<size_t>(total, 1u));
+  const auto spread = gPoissonSpread * std::sqrt(perSubject);
+  cvd::PoissonDisk disk{area, std::max({2. * radius, spread, 1.})};
+  if (avoided) {
+    disk.avoid(*avoided, boundingBox);
+  }
+  std::random_device randomDevice;
+  std::mt19937 generator(randomDevice());
+  return disk.sample(params.number, generator, cancelled);
+}
+
 constexpr auto gSickTime = 10.f;
-constexpr auto gMaxPlotTicks = 10000u;
+constexpr auto gFrameInterval = std::chrono::milliseconds{10u};
+constexpr auto gRecreateDelay = std::chrono::milliseconds{50u};
+//! Subjects generated between two checks for a newer request
+constexpr auto gCancelCheckInterval = 4096u;
+//! Part of the frame interval fast-forwarding may spend on ticks
+constexpr auto gFrameBudget = std::chrono::milliseconds{8u};
+//! Unlimited runs only repaint that often
+constexpr auto gUnlimitedBudget = std::chrono::milliseconds{250u};
+//! Progress of a video export is reported every that many ticks
+constexpr auto gVideoProgressTicks = 10;
 
 } // namespace
 
 namespace cvd {
 MainWindow::MainWindow(QWidget *const parent)
     : QMainWindow{parent}, ui_{std::make_unique<Ui::MainWindow>()},
-      params_{100u, 0.1f, 5.f, gSickTime * 50.f, 10.f, 0.1f} {
+      params_{100u, 0.1f, 5.f, gSickTime * 50.f, 10.f, 0.1f, true, false,
+              false, false},
+      //! The thread starting a loop works on it as well
+      scheduler_{
+          static_cast<unsigned>(std::max(1, QThread::idealThreadCount()) - 1)} {
   ui_->setupUi(this);
 
   const auto *const renderArea = ui_->renderArea;
   assert(renderArea);
   const auto &rect = renderArea->geometry();
-  subjects_ = std::make_shared<Subjects>(generateSubjects(params_, rect));
+  simulation_ = std::make_unique<Simulation>(
+      params_, rect,
+      std::make_shared<Subjects>(generateSubjects(params_, rect)));
+  simulation_->setReorderInterval(reorderInterval_);
+  simulation_->setScheduler(&scheduler_);
+
+  regenerator_ = std::make_unique<Regenerator>(
+      [](const Params &params, const QRect &rect,
+         const Regenerator::Cancelled &cancelled)
+          -> std::unique_ptr<Simulation> {
+        auto subjects = generateSubjects(params, rect, cancelled);
+        if (cancelled()) {
+          return nullptr;
+        }
+        return std::make_unique<Simulation>(
+            params, rect, std::make_shared<Subjects>(std::move(subjects)));
+      },
+      [this] {
+        QMetaObject::invokeMethod(
+            this, [this] { finishedRecreate(); }, Qt::QueuedConnection);
+      });
+  recreateTimer_.setInterval(gRecreateDelay);
+  recreateTimer_.setSingleShot(true);
+  connect(&recreateTimer_, &QTimer::timeout, this,
+          &MainWindow::recreateSubjects);
 
-  timer_.setInterval(std::chrono::milliseconds{10u});
+  timer_.setInterval(gFrameInterval);
   timer_.setSingleShot(false);
   connect(&timer_, SIGNAL(timeout()), this, SLOT(updateRenderArea()));
 
@@ -73,37 +166,86 @@ MainWindow::MainWindow(QWidget *const parent)
           SLOT(updateRadius(int)));
   connect(ui_->sliderSickTime, SIGNAL(valueChanged(int)), this,
           SLOT(updateSickTime(int)));
+  connect(ui_->checkBoxCollisions, SIGNAL(toggled(bool)), this,
+          SLOT(updateCollisions(bool)));
+  connect(ui_->checkBoxFixedPoint, SIGNAL(toggled(bool)), this,
+          SLOT(updateFixedPoint(bool)));
+  connect(ui_->checkBoxPoissonDisk, SIGNAL(toggled(bool)), this,
+          SLOT(updatePoissonDisk(bool)));
+  connect(ui_->checkBoxSuperspreaders, SIGNAL(toggled(bool)), this,
+          SLOT(updateSuperspreaders(bool)));
+  connect(ui_->checkBoxCompact, SIGNAL(toggled(bool)), this,
+          SLOT(updateCompact(bool)));
+  connect(ui_->comboBoxTicksPerFrame, SIGNAL(currentIndexChanged(int)), this,
+          SLOT(updateTicksPerFrame(int)));
+  connect(ui_->checkBoxStopWhenHealthy, SIGNAL(toggled(bool)), this,
+          SLOT(updateStopWhenHealthy(bool)));
+  connect(ui_->spinBoxFlatTicks, SIGNAL(valueChanged(int)), this,
+          SLOT(updateFlatTicks(int)));
+  connect(ui_->spinBoxReorderTicks, SIGNAL(valueChanged(int)), this,
+          SLOT(updateReorderTicks(int)));
   connect(ui_->pushButtonStart, SIGNAL(clicked()), this, SLOT(clickedStart()));
   connect(ui_->pushButtonStop, SIGNAL(clicked()), this, SLOT(clickedStop()));
   connect(ui_->pushButtonRecreate, SIGNAL(clicked()), this,
           SLOT(clickedRecreate()));
-
-  ui_->plot->clearGraphs();
-  plots_.sick.reset(ui_->plot->addGraph());
-  plots_.recovered.reset(ui_->plot->addGraph());
-  plots_.totalSick.reset(ui_->plot->addGraph());
-  plots_.capacity.reset(ui_->plot->addGraph());
-  plots_.sick->setPen(QPen{Qt::red});
-  plots_.recovered->setPen(QPen{Qt::blue});
-  plots_.totalSick->setPen(QPen{Qt::red});
-  plots_.capacity->setPen(QPen{QColor{60, 60, 60, 255}, 1.5f, Qt::DotLine});
-  ui_->plot->xAxis->setRange(0, gMaxPlotTicks);
+  connect(ui_->pushButtonSave, SIGNAL(clicked()), this, SLOT(clickedSave()));
+  connect(ui_->pushButtonLoad, SIGNAL(clicked()), this, SLOT(clickedLoad()));
+  connect(ui_->pushButtonRecord, SIGNAL(toggled(bool)), this,
+          SLOT(toggledRecord(bool)));
+  connect(ui_->pushButtonReplay, SIGNAL(toggled(bool)), this,
+          SLOT(toggledReplay(bool)));
+  connect(ui_->pushButtonExport, SIGNAL(toggled(bool)), this,
+          SLOT(toggledExport(bool)));
+  connect(ui_->pushButtonVideo, SIGNAL(clicked()), this,
+          SLOT(clickedVideo()));
+  connect(ui_->sliderReplay, SIGNAL(valueChanged(int)), this,
+          SLOT(seekReplay(int)));
+
+  replayTimer_.setInterval(std::chrono::milliseconds{10u});
+  replayTimer_.setSingleShot(false);
+  connect(&replayTimer_, SIGNAL(timeout()), this, SLOT(updateReplay()));
+
+  plots_ = std::make_unique<StatisticsPlot>(ui_->plot);
   ui_->plot->yAxis->setRange(0, params_.number);
+  clearPlots();
 
   connect(&timer_, SIGNAL(timeout()), this, SLOT(updatePlot()));
 }
 
-Subjects MainWindow::generateSubjects(const Params &params, const QRect &rect) {
+MainWindow::~MainWindow() {
+  //! Its worker posts results to the window
+  regenerator_.reset();
+  if (videoWriter_.joinable()) {
+    videoCanceled_ = true;
+    videoWriter_.join();
+  }
+  if (checkpointWriter_.joinable()) {
+    checkpointWriter_.join();
+  }
+}
+
+Subjects MainWindow::generateSubjects(const Params &params, const QRect &rect,
+                                      const Regenerator::Cancelled &cancelled,
+                                      const Subjects *avoided) {
+  //! Uniform positions for whoever does not fit
+  const auto positions =
+      params.poissonDisk
+          ? generatePoissonPositions(params, rect, cancelled, avoided)
+          : std::vector<QPointF>{};
   Subjects result;
   result.reserve(params.number);
   for (auto i = 0u; i < params.number; ++i) {
+    if (cancelled && i % gCancelCheckInterval == 0u && cancelled()) {
+      return result;
+    }
     assert(params.sickPercentage >= 0.f && params.sickPercentage <= 1.f);
     bool sick = i < static_cast<size_t>(params.sickPercentage * params.number);
     result.push_back(Subject{
-        generateRandomPosition(rect),
+        i < positions.size() ? positions[i] : generateRandomPosition(rect),
         generateRandomDirection(rect),
         generateRandomSpeed(rect, params.minimalSpeed),
-        params.radius,
+        params.superspreaders ? generateRandomRadius(params.radius)
+                              : params.radius,
         sick ? Subject::Status::Sick : Subject::Status::Healthy,
         sick ? params.sickTime : -1.f,
         false,
@@ -129,108 +271,107 @@ Subjects MainWindow::generateSubjects(const Params &params, const QRect &rect) {
   return result;
 }
 
-void MainWindow::updateSubjects() {
-  assert(subjects_);
-  for (auto subject_it = subjects_->begin(); subject_it < subjects_->end();
-       ++subject_it) {
-    auto &pos = subject_it->pos;
-    auto &direction = subject_it->direction;
-    const auto &speed = subject_it->speed;
-    const auto &radius = subject_it->radius;
-    auto &status = subject_it->status;
-    auto &sickTimeRemaining = subject_it->sickTimeRemaining;
-
-    if (status == Subject::Status::Sick) {
-      assert(sickTimeRemaining >= 0.);
-      sickTimeRemaining -= gDeltaT;
-      if (sickTimeRemaining < 0.) {
-        status = Subject::Status::Recovered;
-      }
-    }
+void MainWindow::updateRenderArea() {
+  if (!pipeline_.inFlight()) {
+    submitFrame();
+    return;
+  }
+  //! Polled until the frame is done, so the window stays responsive
+  if (const auto frame = pipeline_.take()) {
+    finishFrame(*frame, true);
+    return;
+  }
+  //! Long frames publish snapshots on their way
+  ui_->renderArea->refresh();
+}
 
-    if (subject_it->freezed) {
-      continue;
-    }
+void MainWindow::submitFrame() {
+  using Clock = std::chrono::steady_clock;
+  auto request = TickPipeline::Request{
+      simulation_.get(),
+      recorder_.get(),
+      &ui_->renderArea->snapshots(),
+      ui_->renderArea->compact(),
+      std::numeric_limits<uint64_t>::max(),
+      Clock::duration::max(),
+      stopWhenHealthy_,
+      flatTicksLimit_,
+      flatTicks_,
+      history_.empty() ? std::nullopt
+                       : std::optional<size_t>{history_.back().sick},
+  };
+  switch (fastForward_) {
+  case FastForward::Multiplier:
+    request.maxTicks = ticksPerFrame_;
+    break;
+  case FastForward::FrameBudget:
+    request.budget = gFrameBudget;
+    break;
+  case FastForward::Unlimited:
+    //! Stops as soon as nobody is sick
+    request.budget = gUnlimitedBudget;
+    request.stopWhenHealthy = true;
+    break;
+  default:
+    assert(false);
+  }
+  pipeline_.submit(request);
+}
 
-    auto newPos = QPointF{
-        pos.x() + direction.x() * speed * gDeltaT,
-        pos.y() + direction.y() * speed * gDeltaT,
-    };
-
-    auto *renderArea = ui_->renderArea;
-    assert(renderArea);
-    const auto &rect = renderArea->geometry();
-
-    //! Detect edges collisions
-    {
-      if (newPos.x() - radius <= rect.left() ||
-          newPos.x() + radius >= rect.right()) {
-        direction.setX(-1.f * direction.x());
-        newPos.rx() += direction.x() * speed * gDeltaT * 2.f;
-      }
+void MainWindow::finishFrame(const TickPipeline::Frame &frame,
+                             const bool next) {
+  const auto &statistics = frame.statistics;
+  const auto first = frame.ticks + 1u - statistics.size();
+  history_.insert(history_.end(), statistics.begin(), statistics.end());
+  flatTicks_ = frame.flatTicks;
+  //! The next frame is simulated while this one is exported and drawn
+  if (next && frame.running) {
+    submitFrame();
+  }
 
-      if (newPos.y() - radius <= rect.top() ||
-          newPos.y() + radius >= rect.bottom()) {
-        direction.setY(-1.f * direction.y());
-        newPos.ry() += direction.y() * speed * gDeltaT * 2.f;
-      }
+  for (auto i = size_t{0u}; i < statistics.size(); ++i) {
+    if (exporter_) {
+      exporter_->append(first + i, statistics[i]);
     }
-
-    //! Detect subjects collisions
-    {
-      for (auto other_subject_it = subjects_->begin();
-           other_subject_it < subjects_->end(); ++other_subject_it) {
-        const auto other_subject_id =
-            std::distance(subjects_->begin(), other_subject_it);
-        const auto subject_id = std::distance(subjects_->begin(), subject_it);
-        if (other_subject_id == subject_id) {
-          continue;
-        }
-        auto &otherPos = other_subject_it->pos;
-        auto &otherDirection = other_subject_it->direction;
-        auto deltaPos = newPos - otherPos;
-        auto distanceBetweenCenters = std::sqrt(deltaPos.x() * deltaPos.x() +
-                                                deltaPos.y() * deltaPos.y());
-        if (distanceBetweenCenters <= 2.f * radius) {
-          direction.setX(-1.f * direction.x());
-          direction.setY(-1.f * direction.y());
-          newPos.rx() += direction.x() * speed * gDeltaT * 2.f;
-          newPos.ry() += direction.y() * speed * gDeltaT * 2.f;
-          pos = newPos;
-          otherDirection.setX(-1.f * otherDirection.x());
-          otherDirection.setY(-1.f * otherDirection.y());
-
-          auto &otherStatus = other_subject_it->status;
-          auto &otherSickTimeRemaining = other_subject_it->sickTimeRemaining;
-          if (status == Subject::Status::Sick ||
-              otherStatus == Subject::Status::Sick) {
-            if (status != Subject::Status::Sick &&
-                status != Subject::Status::Recovered) {
-              status = Subject::Status::Sick;
-              sickTimeRemaining = params_.sickTime;
-            }
-            if (otherStatus != Subject::Status::Sick &&
-                otherStatus != Subject::Status::Recovered) {
-              otherStatus = Subject::Status::Sick;
-              otherSickTimeRemaining = params_.sickTime;
-            }
-          }
-        }
-      }
+    //! Once nobody is sick the curves stay flat, the run keeps moving
+    //! subjects without plotting if it is not stopped
+    if (!idle_) {
+      plots_->add(statistics[i]);
+      replotPending_ = true;
     }
-    pos = newPos;
+    idle_ = statistics[i].sick == 0u;
+  }
+
+  //! Only the latest snapshot is shown
+  ui_->renderArea->refresh();
+  showReorderCost(frame.reorderCost);
+  if (!frame.running && timer_.isActive()) {
+    clickedStop();
   }
 }
 
-void MainWindow::updateRenderArea() {
-  updateSubjects();
-  auto *renderArea = ui_->renderArea;
-  renderArea->redraw(subjects_);
+void MainWindow::drainPipeline() {
+  if (const auto frame = pipeline_.wait()) {
+    finishFrame(*frame, false);
+  }
+}
+
+void MainWindow::resetRunState() {
+  flatTicks_ = 0u;
+  idle_ = false;
+  showReorderCost(simulation_->reorderCost());
 }
 
 void MainWindow::updateSpeed(const int value) {
+  drainPipeline();
+  const auto previous = params_.minimalSpeed;
   params_.minimalSpeed = static_cast<float>(value);
-  clickedRecreate();
+  //! Speeds are rescaled, impossible from or to zero
+  if (!runStarted() || previous <= 0.f || params_.minimalSpeed <= 0.f) {
+    clickedRecreate();
+    return;
+  }
+  simulation_->setMinimalSpeed(params_.minimalSpeed);
 }
 
 void MainWindow::updateSickPercentage(const int value) {
@@ -250,26 +391,165 @@ void MainWindow::updateFreezePercentage(const int value) {
 }
 
 void MainWindow::updateNumber(const int value) {
+  drainPipeline();
   params_.number = static_cast<size_t>(value);
-  clickedRecreate();
+  if (!runStarted()) {
+    clickedRecreate();
+    return;
+  }
+
+  const auto size = simulation_->subjects()->size();
+  if (params_.number < size) {
+    simulation_->removeSubjects(size - params_.number);
+  } else if (params_.number > size) {
+    //! Newcomers are healthy and moving
+    auto newcomers = params_;
+    newcomers.number = params_.number - size;
+    newcomers.sickPercentage = 0.f;
+    newcomers.freezePercentage = 0.f;
+    const auto &subjects = *simulation_->subjects();
+    simulation_->addSubjects(
+        generateSubjects(newcomers, simulation_->bounds(), {}, &subjects));
+  }
+  if (!player_) {
+    redrawSimulation();
+  }
 }
 
 void MainWindow::updateRadius(int value) {
+  drainPipeline();
   params_.radius = static_cast<float>(value);
-  clickedRecreate();
+  if (!runStarted()) {
+    clickedRecreate();
+    return;
+  }
+  simulation_->setRadius(params_.radius);
+  if (!player_) {
+    redrawSimulation();
+  }
 }
 
 void MainWindow::updateSickTime(int value) {
+  drainPipeline();
   params_.sickTime = gSickTime * static_cast<float>(value);
+  if (!runStarted()) {
+    clickedRecreate();
+    return;
+  }
+  simulation_->setSickTime(params_.sickTime);
+}
+
+bool MainWindow::runStarted() const {
+  //! A pending regeneration replaces the run anyway
+  return simulation_->ticks() > 0u && !recreateTimer_.isActive();
+}
+
+void MainWindow::updateCollisions(const bool checked) {
+  drainPipeline();
+  params_.collisions = checked;
+  simulation_->setCollisions(checked);
+}
+
+void MainWindow::updateFixedPoint(const bool checked) {
+  params_.fixedPoint = checked;
   clickedRecreate();
 }
 
+void MainWindow::updatePoissonDisk(const bool checked) {
+  params_.poissonDisk = checked;
+  clickedRecreate();
+}
+
+void MainWindow::updateSuperspreaders(const bool checked) {
+  params_.superspreaders = checked;
+  clickedRecreate();
+}
+
+void MainWindow::updateCompact(const bool checked) {
+  drainPipeline();
+  ui_->renderArea->setCompact(checked);
+  if (player_) {
+    ui_->renderArea->redraw(*player_->subjects());
+  } else {
+    redrawSimulation();
+  }
+}
+
+void MainWindow::redrawSimulation() {
+  if (ui_->renderArea->compact()) {
+    //! Packed snapshots carry the sick time left
+    simulation_->syncSickTime();
+  }
+  ui_->renderArea->redraw(*simulation_->subjects());
+}
+
+void MainWindow::updateTicksPerFrame(const int index) {
+  //! Same order as the combo box entries
+  constexpr unsigned multipliers[] = {1u, 10u, 100u};
+  constexpr auto multiplierEntries = static_cast<int>(std::size(multipliers));
+  if (index < multiplierEntries) {
+    fastForward_ = FastForward::Multiplier;
+    ticksPerFrame_ = multipliers[index];
+  } else {
+    fastForward_ = index == multiplierEntries ? FastForward::FrameBudget
+                                              : FastForward::Unlimited;
+  }
+}
+
+void MainWindow::updateStopWhenHealthy(const bool checked) {
+  stopWhenHealthy_ = checked;
+}
+
+void MainWindow::updateFlatTicks(const int value) {
+  flatTicksLimit_ = static_cast<size_t>(value);
+}
+
+void MainWindow::updateReorderTicks(const int value) {
+  drainPipeline();
+  reorderInterval_ = static_cast<uint32_t>(value);
+  simulation_->setReorderInterval(reorderInterval_);
+}
+
+void MainWindow::showReorderCost(const Simulation::ReorderCost &cost) {
+  if (cost.reorders == 0u) {
+    ui_->labelReorderCost->clear();
+    return;
+  }
+  using Microseconds = std::chrono::duration<double, std::micro>;
+  const auto average = Microseconds{cost.total}.count() /
+                       static_cast<double>(cost.reorders);
+  ui_->labelReorderCost->setText(
+      tr("Re-sort took %1 us, %2 us on average")
+          .arg(Microseconds{cost.last}.count(), 0, 'f', 0)
+          .arg(average, 0, 'f', 0));
+}
+
 void MainWindow::recreateSubjects() {
-  auto *const renderArea = ui_->renderArea;
+  const auto *const renderArea = ui_->renderArea;
   assert(renderArea);
-  const auto &rect = renderArea->geometry();
-  subjects_ = std::make_shared<Subjects>(generateSubjects(params_, rect));
-  renderArea->redraw(subjects_);
+  regenerator_->request(params_, renderArea->geometry());
+}
+
+void MainWindow::finishedRecreate() {
+  auto simulation = regenerator_->take();
+  if (!simulation) {
+    return;
+  }
+
+  if (timer_.isActive()) {
+    clickedStop();
+  }
+  //! An export covers a single run
+  ui_->pushButtonExport->setChecked(false);
+  simulation_ = std::move(simulation);
+  simulation_->setReorderInterval(reorderInterval_);
+  simulation_->setScheduler(&scheduler_);
+  if (!player_) {
+    redrawSimulation();
+    clearPlots();
+  }
+  history_.clear();
+  resetRunState();
 }
 
 void MainWindow::clickedStart() {
@@ -277,12 +557,11 @@ void MainWindow::clickedStart() {
   assert(!ui_->pushButtonStop->isEnabled());
   ui_->pushButtonStop->setEnabled(true);
   ui_->pushButtonStart->setEnabled(false);
-
-  clearPlots();
 }
 
 void MainWindow::clickedStop() {
   timer_.stop();
+  drainPipeline();
   assert(!ui_->pushButtonStart->isEnabled());
   ui_->pushButtonStart->setEnabled(true);
   ui_->pushButtonStop->setEnabled(false);
@@ -291,58 +570,402 @@ void MainWindow::clickedStop() {
 void MainWindow::clickedRecreate() {
   if (timer_.isActive()) {
     timer_.stop();
+    drainPipeline();
     assert(!ui_->pushButtonStart->isEnabled());
     assert(ui_->pushButtonStop->isEnabled());
     ui_->pushButtonStart->setEnabled(true);
     ui_->pushButtonStop->setEnabled(false);
   }
-  recreateSubjects();
+  //! Restarted by every change, only the last one is regenerated
+  recreateTimer_.start();
 }
 void MainWindow::updatePlot() {
-  const auto sickNumber = std::count_if(
-      subjects_->begin(), subjects_->end(), [](const auto &subject) {
-        return subject.status == Subject::Status::Sick;
-      });
+  if (replotPending_) {
+    ui_->plot->replot();
+    replotPending_ = false;
+  }
+}
 
-  {
-    plots_.sick->addData(plots_.ticks, 0);
-    plots_.sick->addData(plots_.ticks, sickNumber);
+void MainWindow::clickedSave() {
+  const auto path = QFileDialog::getSaveFileName(
+      this, tr("Save checkpoint"), {}, tr("Checkpoints (*.cvd)"));
+  if (path.isEmpty()) {
+    return;
   }
 
-  {
-    const auto recoveredNumber = std::count_if(
-        subjects_->begin(), subjects_->end(), [](const auto &subject) {
-          return subject.status == Subject::Status::Recovered;
-        });
+  //! Only the snapshot is taken on the GUI thread, the simulation may keep
+  //! running while it is written.
+  drainPipeline();
+  simulation_->syncSickTime();
+  auto checkpoint = Checkpoint{
+      simulation_->params(), simulation_->bounds(), simulation_->ticks(),
+      history_,              *simulation_->subjects(),
+  };
+  if (checkpointWriter_.joinable()) {
+    checkpointWriter_.join();
+  }
+  checkpointWriter_ = std::thread{
+      [this, path, checkpoint = std::move(checkpoint)] {
+        if (!writeCheckpoint(path, checkpoint)) {
+          QMetaObject::invokeMethod(
+              this,
+              [this, path] {
+                QMessageBox::warning(this, tr("Save checkpoint"),
+                                     tr("Failed to write %1").arg(path));
+              },
+              Qt::QueuedConnection);
+        }
+      }};
+}
 
-    plots_.recovered->addData(plots_.ticks, params_.number);
-    plots_.recovered->addData(plots_.ticks, params_.number - recoveredNumber);
+void MainWindow::clickedLoad() {
+  const auto path = QFileDialog::getOpenFileName(
+      this, tr("Load checkpoint"), {}, tr("Checkpoints (*.cvd)"));
+  if (path.isEmpty()) {
+    return;
+  }
+  auto checkpoint = readCheckpoint(path);
+  if (!checkpoint) {
+    QMessageBox::warning(this, tr("Load checkpoint"),
+                         tr("%1 is not a valid checkpoint").arg(path));
+    return;
   }
 
+  if (timer_.isActive()) {
+    clickedStop();
+  }
+  //! A pending regeneration would replace the loaded run
+  recreateTimer_.stop();
+  regenerator_->cancel();
+  ui_->pushButtonExport->setChecked(false);
+  params_ = checkpoint->params;
+  syncControls();
+  simulation_ = std::make_unique<Simulation>(
+      params_, checkpoint->bounds,
+      std::make_shared<Subjects>(std::move(checkpoint->subjects)),
+      checkpoint->ticks);
+  simulation_->setReorderInterval(reorderInterval_);
+  simulation_->setScheduler(&scheduler_);
+  redrawSimulation();
+
+  history_ = std::move(checkpoint->history);
+  resetRunState();
+  replotHistory();
+}
+
+void MainWindow::toggledRecord(const bool checked) {
+  drainPipeline();
+  if (!checked) {
+    if (recorder_) {
+      const auto path = recorder_->path();
+      const auto written = recorder_->finish();
+      recorder_.reset();
+      if (!written) {
+        QMessageBox::warning(this, tr("Record trajectory"),
+                             tr("Failed to write %1").arg(path));
+      }
+    }
+    return;
+  }
+
+  const auto path = QFileDialog::getSaveFileName(
+      this, tr("Record trajectory"), {}, tr("Trajectories (*.cvdt)"));
+  if (!path.isEmpty()) {
+    auto recorder =
+        std::make_unique<TrajectoryRecorder>(path, simulation_->bounds());
+    if (recorder->isOpen()) {
+      //! Frames kept running while the dialog was open
+      drainPipeline();
+      recorder_ = std::move(recorder);
+      recorder_->record(simulation_->ticks(), *simulation_->subjects(),
+                      simulation_->ids());
+      return;
+    }
+    QMessageBox::warning(this, tr("Record trajectory"),
+                         tr("Failed to open %1").arg(path));
+  }
+
+  const QSignalBlocker blocker{ui_->pushButtonRecord};
+  ui_->pushButtonRecord->setChecked(false);
+}
+
+void MainWindow::toggledReplay(const bool checked) {
+  if (!checked) {
+    replayTimer_.stop();
+    player_.reset();
+    ui_->sliderReplay->setEnabled(false);
+    ui_->spinBoxReplaySpeed->setEnabled(false);
+    ui_->pushButtonStart->setEnabled(true);
+    ui_->pushButtonRecreate->setEnabled(true);
+    ui_->pushButtonLoad->setEnabled(true);
+    ui_->pushButtonRecord->setEnabled(true);
+    redrawSimulation();
+    replotHistory();
+    return;
+  }
+
+  const auto path = QFileDialog::getOpenFileName(
+      this, tr("Replay trajectory"), {}, tr("Trajectories (*.cvdt)"));
+  if (!path.isEmpty()) {
+    auto player = std::make_unique<TrajectoryPlayer>(path);
+    if (player->isOpen()) {
+      player->setScheduler(&scheduler_);
+      player_ = std::move(player);
+    } else {
+      QMessageBox::warning(this, tr("Replay trajectory"),
+                           tr("%1 is not a valid trajectory").arg(path));
+    }
+  }
+  if (!player_) {
+    const QSignalBlocker blocker{ui_->pushButtonReplay};
+    ui_->pushButtonReplay->setChecked(false);
+    return;
+  }
+
+  //! The simulation is kept aside and restored when the replay ends
+  if (timer_.isActive()) {
+    clickedStop();
+  }
+  ui_->pushButtonRecord->setChecked(false);
+  ui_->pushButtonStart->setEnabled(false);
+  ui_->pushButtonRecreate->setEnabled(false);
+  ui_->pushButtonLoad->setEnabled(false);
+  ui_->pushButtonRecord->setEnabled(false);
+
   {
-    plots_.totalSick->data()->clear();
-    plots_.totalSick->addData(0, sickNumber);
-    plots_.totalSick->addData(gMaxPlotTicks, sickNumber);
+    const QSignalBlocker blocker{ui_->sliderReplay};
+    ui_->sliderReplay->setRange(static_cast<int>(player_->firstTick()),
+                                static_cast<int>(player_->lastTick()));
+    ui_->sliderReplay->setValue(static_cast<int>(player_->tick()));
+  }
+  ui_->sliderReplay->setEnabled(true);
+  ui_->spinBoxReplaySpeed->setEnabled(true);
+
+  clearPlots();
+  const auto statistics = player_->statistics();
+  ui_->plot->yAxis->setRange(0, statistics.healthy + statistics.sick +
+                                    statistics.recovered);
+  replayFrames_ = 0.;
+  showReplayFrame();
+  replayTimer_.start();
+}
+
+void MainWindow::updateReplay() {
+  //! Fractional speeds skip timer ticks, faster ones decode several frames
+  //! but only the last one is drawn.
+  replayFrames_ += ui_->spinBoxReplaySpeed->value();
+  auto advanced = false;
+  for (; replayFrames_ >= 1.; replayFrames_ -= 1.) {
+    if (!player_->next()) {
+      replayFrames_ = 0.;
+      break;
+    }
+    plots_->seek(player_->tick());
+    plots_->add(player_->statistics());
+    advanced = true;
+  }
+  if (!advanced) {
+    return;
   }
 
   {
-    //! \todo: Make it parameterizable
-    constexpr auto capacity = 30u;
-    plots_.capacity->data()->clear();
-    plots_.capacity->addData(0, capacity);
-    plots_.capacity->addData(gMaxPlotTicks, capacity);
+    const QSignalBlocker blocker{ui_->sliderReplay};
+    ui_->sliderReplay->setValue(static_cast<int>(player_->tick()));
+  }
+  ui_->renderArea->redraw(*player_->subjects());
+  ui_->plot->replot();
+}
+
+void MainWindow::seekReplay(const int tick) {
+  if (!player_ || !player_->seek(static_cast<uint64_t>(tick))) {
+    return;
+  }
+  showReplayFrame();
+}
+
+void MainWindow::toggledExport(const bool checked) {
+  if (!checked) {
+    if (exporter_) {
+      const auto path = exporter_->path();
+      const auto written = exporter_->finish();
+      exporter_.reset();
+      if (!written) {
+        QMessageBox::warning(this, tr("Export statistics"),
+                             tr("Failed to write %1").arg(path));
+      }
+    }
+    return;
+  }
+
+  auto filter = QString{};
+  const auto path = QFileDialog::getSaveFileName(
+      this, tr("Export statistics"), {},
+      tr("CSV (*.csv);;Arrow IPC (*.arrow)"), &filter);
+  if (!path.isEmpty()) {
+    const auto arrow = path.endsWith(".arrow", Qt::CaseInsensitive) ||
+                       filter.contains("*.arrow");
+    const auto format = arrow ? StatisticsWriter::Format::Arrow
+                              : StatisticsWriter::Format::Csv;
+    auto exporter = std::make_unique<StatisticsWriter>(path, format);
+    if (exporter->isOpen()) {
+      drainPipeline();
+      //! History so far, the following ticks are appended as they come
+      const auto first = simulation_->ticks() + 1u - history_.size();
+      for (auto i = 0u; i < history_.size(); ++i) {
+        exporter->append(first + i, history_[i]);
+      }
+      exporter_ = std::move(exporter);
+      return;
+    }
+    QMessageBox::warning(this, tr("Export statistics"),
+                         tr("Failed to open %1").arg(path));
+  }
+
+  const QSignalBlocker blocker{ui_->pushButtonExport};
+  ui_->pushButtonExport->setChecked(false);
+}
+
+void MainWindow::clickedVideo() {
+  auto filter = QString{};
+  const auto path = QFileDialog::getSaveFileName(
+      this, tr("Export video"), {},
+      tr("Y4M video (*.y4m);;PNG sequence (*.png)"), &filter);
+  if (path.isEmpty()) {
+    return;
+  }
+  auto accepted = false;
+  const auto ticks = QInputDialog::getInt(this, tr("Export video"),
+                                          tr("Ticks to export"), 1000, 1,
+                                          1000000, 100, &accepted);
+  if (!accepted) {
+    return;
   }
 
-  plots_.ticks += 1u;
+  const auto png = path.endsWith(".png", Qt::CaseInsensitive) ||
+                   filter.contains("*.png");
+  const auto *const renderArea = ui_->renderArea;
+  auto exporter = std::make_unique<VideoExporter>(
+      path, png ? VideoExporter::Format::Png : VideoExporter::Format::Y4m,
+      simulation_->bounds(),
+      VideoExporter::Style{renderArea->palette().base().color(),
+                           renderArea->palette().dark().color()},
+      static_cast<unsigned>(std::max(1, QThread::idealThreadCount())),
+      &scheduler_);
+  if (!exporter->isOpen()) {
+    QMessageBox::warning(this, tr("Export video"),
+                         tr("Failed to open %1").arg(path));
+    return;
+  }
+
+  //! The export continues the current run headless, on a copy of it
+  if (timer_.isActive()) {
+    clickedStop();
+  }
+  simulation_->syncSickTime();
+  auto simulation = std::make_unique<Simulation>(
+      simulation_->params(), simulation_->bounds(),
+      std::make_shared<Subjects>(*simulation_->subjects()),
+      simulation_->ticks());
+  simulation->setReorderInterval(reorderInterval_);
+  simulation->setScheduler(&scheduler_);
+
+  videoProgress_ = std::make_unique<QProgressDialog>(
+      tr("Exporting video..."), tr("Cancel"), 0, ticks, this);
+  videoProgress_->setWindowModality(Qt::WindowModal);
+  videoProgress_->setMinimumDuration(0);
+  videoCanceled_ = false;
+  connect(videoProgress_.get(), &QProgressDialog::canceled, this,
+          [this] { videoCanceled_ = true; });
+  ui_->pushButtonVideo->setEnabled(false);
+
+  videoWriter_ = std::thread{[this, path, ticks,
+                              simulation = std::move(simulation),
+                              exporter = std::move(exporter)] {
+    exporter->addFrame(*simulation->subjects());
+    for (auto tick = 1; tick <= ticks && !videoCanceled_; ++tick) {
+      simulation->step();
+      exporter->addFrame(*simulation->subjects());
+      if (tick % gVideoProgressTicks == 0) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, tick] {
+              if (videoProgress_) {
+                videoProgress_->setValue(tick);
+              }
+            },
+            Qt::QueuedConnection);
+      }
+    }
+    const auto written = exporter->finish();
+    QMetaObject::invokeMethod(
+        this, [this, written, path] { finishedVideo(written, path); },
+        Qt::QueuedConnection);
+  }};
+}
+
+void MainWindow::finishedVideo(const bool written, const QString &path) {
+  videoWriter_.join();
+  videoProgress_.reset();
+  ui_->pushButtonVideo->setEnabled(true);
+  if (!written) {
+    QMessageBox::warning(this, tr("Export video"),
+                         tr("Failed to write %1").arg(path));
+  }
+}
+
+void MainWindow::showReplayFrame() {
+  //! Drops the curves past the new position, they are plotted again
+  plots_->seek(player_->tick());
+  plots_->add(player_->statistics());
+  ui_->renderArea->redraw(*player_->subjects());
   ui_->plot->replot();
 }
 
+void MainWindow::replotHistory() {
+  clearPlots();
+  ui_->plot->yAxis->setRange(0, params_.number);
+  for (const auto &statistics : history_) {
+    plots_->add(statistics);
+  }
+  ui_->plot->replot();
+}
+
+void MainWindow::syncControls() {
+  //! Controls would regenerate the population on change
+  const auto percentage = [](const QSlider *slider, const float value) {
+    const auto capacity =
+        static_cast<float>(slider->maximum() - slider->minimum());
+    return static_cast<int>(std::lround(value * capacity));
+  };
+  const QSignalBlocker blockers[] = {
+      QSignalBlocker{ui_->sliderNumber},
+      QSignalBlocker{ui_->sliderSpeed},
+      QSignalBlocker{ui_->sliderSickPercentage},
+      QSignalBlocker{ui_->sliderFreezePercentage},
+      QSignalBlocker{ui_->sliderRadius},
+      QSignalBlocker{ui_->sliderSickTime},
+      QSignalBlocker{ui_->checkBoxCollisions},
+      QSignalBlocker{ui_->checkBoxFixedPoint},
+      QSignalBlocker{ui_->checkBoxPoissonDisk},
+      QSignalBlocker{ui_->checkBoxSuperspreaders},
+  };
+  ui_->sliderNumber->setValue(static_cast<int>(params_.number));
+  ui_->sliderSpeed->setValue(static_cast<int>(params_.minimalSpeed));
+  ui_->sliderSickPercentage->setValue(
+      percentage(ui_->sliderSickPercentage, params_.sickPercentage));
+  ui_->sliderFreezePercentage->setValue(
+      percentage(ui_->sliderFreezePercentage, params_.freezePercentage));
+  ui_->sliderRadius->setValue(static_cast<int>(params_.radius));
+  ui_->sliderSickTime->setValue(
+      static_cast<int>(std::lround(params_.sickTime / gSickTime)));
+  ui_->checkBoxCollisions->setChecked(params_.collisions);
+  ui_->checkBoxFixedPoint->setChecked(params_.fixedPoint);
+  ui_->checkBoxPoissonDisk->setChecked(params_.poissonDisk);
+  ui_->checkBoxSuperspreaders->setChecked(params_.superspreaders);
+}
+
 void MainWindow::clearPlots() {
-  plots_.sick->data()->clear();
-  plots_.recovered->data()->clear();
-  plots_.totalSick->data()->clear();
-  plots_.capacity->data()->clear();
-  plots_.ticks = 0u;
+  plots_->clear();
 
   ui_->plot->replot();
 }
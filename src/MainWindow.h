@@ -1,11 +1,25 @@
 #pragma once
 
 #include <QMainWindow>
+#include <QProgressDialog>
 #include <QTimer>
 
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
+#include "Params.h"
+#include "Regenerator.h"
+#include "Simulation.h"
+#include "Statistics.h"
+#include "StatisticsPlot.h"
+#include "StatisticsWriter.h"
 #include "Subject.h"
+#include "TaskScheduler.h"
+#include "TickPipeline.h"
+#include "TrajectoryPlayer.h"
+#include "TrajectoryRecorder.h"
 #include "ui_MainWindow.h"
 
 namespace cvd {
@@ -14,23 +28,45 @@ class MainWindow final : public QMainWindow {
   Q_OBJECT
 public:
   explicit MainWindow(QWidget *parent = nullptr);
+  ~MainWindow() override;
 
 private:
-  struct Params final {
-    size_t number;
-    float sickPercentage;
-    float radius;
-    float sickTime;
-    float minimalSpeed;
-    float freezePercentage;
+  //! How many ticks run between two repaints
+  enum class FastForward {
+    Multiplier,
+    FrameBudget,
+    //! As fast as possible until nobody is sick
+    Unlimited,
   };
 
 private:
-  [[nodiscard]] static Subjects generateSubjects(const Params &params,
-                                                 const QRect &rect);
+  //! Gives up early and returns an incomplete population once
+  //! \p cancelled returns true. Poisson-disk positions keep clear of
+  //! \p avoided as well.
+  [[nodiscard]] static Subjects
+  generateSubjects(const Params &params, const QRect &rect,
+                   const Regenerator::Cancelled &cancelled = {},
+                   const Subjects *avoided = nullptr);
   void recreateSubjects();
-  void updateSubjects();
+  //! Once a run has started, radius, speed, sick time and number changes
+  //! are applied to it instead of starting over.
+  [[nodiscard]] bool runStarted() const;
+  void finishedRecreate();
+  void submitFrame();
+  //! Exports, plots and paints a simulated frame, the next one is submitted
+  //! first if \p next is set.
+  void finishFrame(const TickPipeline::Frame &frame, bool next);
+  //! Waits for the frame in flight, before anything reads or changes the
+  //! simulation, the recorder or the history.
+  void drainPipeline();
+  void resetRunState();
+  void syncControls();
   void clearPlots();
+  void replotHistory();
+  void showReorderCost(const Simulation::ReorderCost &cost);
+  void showReplayFrame();
+  void redrawSimulation();
+  void finishedVideo(bool written, const QString &path);
 
 private slots:
   void updateRenderArea();
@@ -41,23 +77,63 @@ private slots:
   void updateRadius(int value);
   void updateSickTime(int value);
   void updateSpeed(int value);
+  void updateCollisions(bool checked);
+  void updateFixedPoint(bool checked);
+  void updatePoissonDisk(bool checked);
+  void updateSuperspreaders(bool checked);
+  void updateCompact(bool checked);
+  void updateTicksPerFrame(int index);
+  void updateStopWhenHealthy(bool checked);
+  void updateFlatTicks(int value);
+  void updateReorderTicks(int value);
   void clickedStart();
   void clickedStop();
   void clickedRecreate();
+  void clickedSave();
+  void clickedLoad();
+  void toggledRecord(bool checked);
+  void toggledReplay(bool checked);
+  void updateReplay();
+  void seekReplay(int tick);
+  void toggledExport(bool checked);
+  void clickedVideo();
 
 private:
   std::unique_ptr<Ui::MainWindow> ui_;
   Params params_;
-  std::shared_ptr<Subjects> subjects_;
+  //! Shared by the simulations, the player and video exports, so it
+  //! outlives them
+  TaskScheduler scheduler_;
+  std::unique_ptr<Simulation> simulation_;
+  std::vector<Statistics> history_;
   QTimer timer_;
-
-  struct final {
-    size_t ticks;
-    std::unique_ptr<QCPGraph> sick;
-    std::unique_ptr<QCPGraph> recovered;
-    std::unique_ptr<QCPGraph> totalSick;
-    std::unique_ptr<QCPGraph> capacity;
-  } plots_;
+  //! Debounces population regeneration while sliders are dragged
+  QTimer recreateTimer_;
+  FastForward fastForward_ = FastForward::Multiplier;
+  unsigned ticksPerFrame_ = 1u;
+  bool stopWhenHealthy_ = true;
+  //! Zero never stops a run on a flat sick curve
+  size_t flatTicksLimit_ = 0u;
+  size_t flatTicks_ = 0u;
+  //! Ticks between Z-order re-sorts of the subjects, zero never re-sorts
+  uint32_t reorderInterval_ = 100u;
+  //! Nobody is sick anymore, statistics can not change
+  bool idle_ = false;
+  bool replotPending_ = false;
+  std::thread checkpointWriter_;
+  std::unique_ptr<TrajectoryRecorder> recorder_;
+  std::unique_ptr<TrajectoryPlayer> player_;
+  std::unique_ptr<StatisticsWriter> exporter_;
+  std::thread videoWriter_;
+  std::atomic_bool videoCanceled_{false};
+  std::unique_ptr<QProgressDialog> videoProgress_;
+  std::unique_ptr<Regenerator> regenerator_;
+  QTimer replayTimer_;
+  double replayFrames_ = 0.;
+  //! Destroyed before the simulation and the recorder, a frame in flight
+  //! uses them
+  TickPipeline pipeline_;
+  std::unique_ptr<StatisticsPlot> plots_;
 };
 
 } // namespace cvd
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace cvd {
+
+struct Params final {
+  size_t number;
+  float sickPercentage;
+  float radius;
+  float sickTime;
+  float minimalSpeed;
+  float freezePercentage;
+  bool collisions;
+  bool fixedPoint;
+  bool poissonDisk;
+  //! Radii follow a heavy-tailed distribution starting at the radius
+  bool superspreaders;
+};
+
+} // namespace cvd
@@ -0,0 +1,152 @@
+#include "PoissonDisk.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+
+//! Candidates tried around an active sample before it is retired
+constexpr auto gCandidates = 30;
+//! Failed random seeds after which the area is considered full, catches
+//! free pockets the growth from earlier seeds could not reach
+constexpr auto gSeedAttempts = 64;
+//! Active samples processed between two checks for cancellation
+constexpr auto gCancelCheckInterval = 4096u;
+constexpr auto gPi = 3.14159265358979323846;
+//! Infinitely far from everything, empty cells are tested like the others
+const QPointF gEmpty{std::numeric_limits<double>::infinity(),
+                     std::numeric_limits<double>::infinity()};
+
+} // namespace
+
+namespace cvd {
+
+PoissonDisk::PoissonDisk(const QRectF &area, const double distance)
+    : area_{area}, distance_{distance}, cellSize_{distance / std::sqrt(2.)} {
+  assert(distance_ > 0.);
+  columns_ =
+      std::max(1, static_cast<int>(std::ceil(area_.width() / cellSize_)));
+  rows_ =
+      std::max(1, static_cast<int>(std::ceil(area_.height() / cellSize_)));
+  cells_.assign(static_cast<size_t>(columns_) * static_cast<size_t>(rows_),
+                gEmpty);
+}
+
+void PoissonDisk::avoid(const Subjects &subjects, const QRect &bounds) {
+  avoided_ = &subjects;
+  //! Cells as large as the distance, so the 3x3 neighbourhood covers it
+  avoidedGrid_.rebuild(subjects, 0u, subjects.size(), bounds,
+                       static_cast<float>(distance_));
+}
+
+std::vector<QPointF>
+PoissonDisk::sample(const size_t count, std::mt19937 &generator,
+                    const std::function<bool()> &cancelled) {
+  std::uniform_real_distribution<> unit{0., 1.};
+  auto failedSeeds = 0;
+  auto steps = 0u;
+  while (failedSeeds < gSeedAttempts) {
+    const auto seed = QPointF{area_.left() + unit(generator) * area_.width(),
+                              area_.top() + unit(generator) * area_.height()};
+    if (!fits(seed)) {
+      ++failedSeeds;
+      continue;
+    }
+    failedSeeds = 0;
+    add(seed);
+
+    while (!active_.empty()) {
+      if (cancelled && ++steps % gCancelCheckInterval == 0u && cancelled()) {
+        return {};
+      }
+      //! The newest active sample rather than a random one keeps the front
+      //! compact, so the grid cells it touches stay in cache
+      const auto active = active_.size() - 1u;
+      const auto center = samples_[active_[active]];
+      auto found = false;
+      for (auto i = 0; i < gCandidates && !found; ++i) {
+        //! Uniform over the annulus between one and two distances
+        const auto angle = 2. * gPi * unit(generator);
+        const auto radius = distance_ * std::sqrt(1. + 3. * unit(generator));
+        const auto candidate = center + QPointF{radius * std::cos(angle),
+                                                radius * std::sin(angle)};
+        if (fits(candidate)) {
+          add(candidate);
+          found = true;
+        }
+      }
+      if (!found) {
+        active_.pop_back();
+      }
+    }
+  }
+
+  //! Growth order is spatially coherent, pick the requested number at
+  //! random so they spread over the whole area
+  const auto picked = std::min(count, samples_.size());
+  for (auto i = 0u; i < picked; ++i) {
+    std::uniform_int_distribution<size_t> pick{i, samples_.size() - 1u};
+    std::swap(samples_[i], samples_[pick(generator)]);
+  }
+  return std::vector<QPointF>(samples_.begin(),
+                              samples_.begin() +
+                                  static_cast<ptrdiff_t>(picked));
+}
+
+bool PoissonDisk::fits(const QPointF &point) const {
+  if (!area_.contains(point)) {
+    return false;
+  }
+
+  const auto squaredDistance = distance_ * distance_;
+  const auto near = [&point, squaredDistance](const QPointF &other) {
+    const auto delta = point - other;
+    return delta.x() * delta.x() + delta.y() * delta.y() < squaredDistance;
+  };
+
+  //! The distance spans two cells of the background grid, the corners of
+  //! the 5x5 neighbourhood are at least the distance away
+  const auto center = cell(point);
+  const auto column = static_cast<int>(center % static_cast<size_t>(columns_));
+  const auto row = static_cast<int>(center / static_cast<size_t>(columns_));
+  auto blocked = false;
+  for (auto y = std::max(0, row - 2); y <= std::min(rows_ - 1, row + 2); ++y) {
+    const auto corner = std::abs(y - row) == 2 ? 1 : 0;
+    const auto first = std::max(0, column - 2 + corner);
+    const auto last = std::min(columns_ - 1, column + 2 - corner);
+    const auto *const cells = cells_.data() + y * columns_;
+    for (auto x = first; x <= last; ++x) {
+      blocked |= near(cells[x]);
+    }
+  }
+  if (blocked) {
+    return false;
+  }
+
+  if (avoided_) {
+    avoidedGrid_.forEachNear(point, [this, &near, &blocked](const uint32_t id) {
+      blocked = blocked || near((*avoided_)[id].pos);
+    });
+    return !blocked;
+  }
+  return true;
+}
+
+void PoissonDisk::add(const QPointF &point) {
+  cells_[cell(point)] = point;
+  active_.push_back(static_cast<uint32_t>(samples_.size()));
+  samples_.push_back(point);
+}
+
+size_t PoissonDisk::cell(const QPointF &point) const {
+  const auto column = std::min(
+      columns_ - 1, static_cast<int>((point.x() - area_.left()) / cellSize_));
+  const auto row = std::min(
+      rows_ - 1, static_cast<int>((point.y() - area_.top()) / cellSize_));
+  return static_cast<size_t>(row * columns_ + column);
+}
+
+} // namespace cvd
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QPointF>
+#include <QRect>
+#include <QRectF>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "SpatialGrid.h"
+#include "Subject.h"
+
+namespace cvd {
+
+//! Bridson's Poisson-disk sampling: random points at least a given
+//! distance apart, grown from seeds by trying candidates around active
+//! points. A background grid with cells small enough to hold one sample
+//! each makes every test O(1), so sampling runs in linear time.
+class PoissonDisk final {
+public:
+  PoissonDisk(const QRectF &area, double distance);
+
+  //! New samples keep their distance to \p subjects as well.
+  void avoid(const Subjects &subjects, const QRect &bounds);
+
+  //! Fills the area until no more samples fit and returns \p count of them
+  //! chosen at random, fewer if fewer fit. Gives up and returns nothing
+  //! once \p cancelled returns true, it is polled every few samples.
+  [[nodiscard]] std::vector<QPointF>
+  sample(size_t count, std::mt19937 &generator,
+         const std::function<bool()> &cancelled = {});
+
+private:
+  [[nodiscard]] bool fits(const QPointF &point) const;
+  void add(const QPointF &point);
+  [[nodiscard]] size_t cell(const QPointF &point) const;
+
+private:
+  QRectF area_;
+  double distance_;
+  double cellSize_;
+  int columns_;
+  int rows_;
+  //! The sample in each cell, at most one fits
+  std::vector<QPointF> cells_;
+  std::vector<QPointF> samples_;
+  std::vector<uint32_t> active_;
+
+  const Subjects *avoided_ = nullptr;
+  SpatialGrid avoidedGrid_;
+};
+
+} // namespace cvd
@@ -0,0 +1,76 @@
+#include "Regenerator.h"
+
+#include <cassert>
+
+namespace cvd {
+
+Regenerator::Regenerator(Build build, Ready ready)
+    : build_{std::move(build)}, ready_{std::move(ready)} {
+  assert(build_ && ready_);
+  worker_ = std::thread{[this] { run(); }};
+}
+
+Regenerator::~Regenerator() {
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  //! Cancels the build in progress as well
+  ++latest_;
+  condition_.notify_all();
+  worker_.join();
+}
+
+void Regenerator::request(const Params &params, const QRect &bounds) {
+  {
+    std::lock_guard lock{mutex_};
+    pending_ = Request{params, bounds, ++latest_};
+  }
+  condition_.notify_all();
+}
+
+void Regenerator::cancel() {
+  std::lock_guard lock{mutex_};
+  pending_.reset();
+  ++latest_;
+}
+
+std::unique_ptr<Simulation> Regenerator::take() {
+  std::lock_guard lock{mutex_};
+  if (resultGeneration_ != latest_) {
+    return nullptr;
+  }
+  return std::move(result_);
+}
+
+void Regenerator::run() {
+  for (;;) {
+    Request request;
+    {
+      std::unique_lock lock{mutex_};
+      condition_.wait(lock, [this] { return stopping_ || pending_; });
+      if (stopping_) {
+        return;
+      }
+      request = *pending_;
+      pending_.reset();
+    }
+
+    const auto generation = request.generation;
+    auto simulation =
+        build_(request.params, request.bounds,
+               [this, generation] { return generation != latest_; });
+    if (!simulation || generation != latest_) {
+      continue;
+    }
+
+    {
+      std::lock_guard lock{mutex_};
+      result_ = std::move(simulation);
+      resultGeneration_ = generation;
+    }
+    ready_();
+  }
+}
+
+} // namespace cvd
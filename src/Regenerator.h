@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QRect>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "Params.h"
+#include "Simulation.h"
+
+namespace cvd {
+
+//! Builds simulations for new parameters on a worker thread. Only the
+//! latest request matters: a request replaces any pending one and cancels
+//! the build in progress, stale results are never handed out.
+class Regenerator final {
+public:
+  //! True once the build in progress became stale
+  using Cancelled = std::function<bool()>;
+  //! Returns null if it gave up on a cancelled build
+  using Build = std::function<std::unique_ptr<Simulation>(
+      const Params &, const QRect &, const Cancelled &)>;
+  //! Called on the worker thread when a result can be taken
+  using Ready = std::function<void()>;
+
+  Regenerator(Build build, Ready ready);
+  ~Regenerator();
+
+  Regenerator(const Regenerator &) = delete;
+  Regenerator &operator=(const Regenerator &) = delete;
+
+  void request(const Params &params, const QRect &bounds);
+  //! Drops the pending request and the build in progress.
+  void cancel();
+  //! The simulation built for the latest request, null if it is not done.
+  [[nodiscard]] std::unique_ptr<Simulation> take();
+
+private:
+  struct Request final {
+    Params params;
+    QRect bounds;
+    uint64_t generation;
+  };
+
+  void run();
+
+private:
+  Build build_;
+  Ready ready_;
+  std::atomic<uint64_t> latest_{0u};
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::optional<Request> pending_;
+  std::unique_ptr<Simulation> result_;
+  uint64_t resultGeneration_ = 0u;
+  bool stopping_ = false;
+
+  std::thread worker_;
+};
+
+} // namespace cvd
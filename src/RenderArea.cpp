@@ -2,6 +2,35 @@
 
 #include <QPainter>
 
+namespace {
+
+//! Puts back what painting subjects changes. A painter saves its whole
+//! state on the heap, this keeps the few settings in place.
+class PainterState final {
+public:
+  explicit PainterState(QPainter &painter)
+      : painter_{painter}, pen_{painter.pen()}, brush_{painter.brush()},
+        antialiased_{painter.testRenderHint(QPainter::Antialiasing)} {
+    painter.setRenderHint(QPainter::Antialiasing, true);
+  }
+  ~PainterState() {
+    painter_.setPen(pen_);
+    painter_.setBrush(brush_);
+    painter_.setRenderHint(QPainter::Antialiasing, antialiased_);
+  }
+
+  PainterState(const PainterState &) = delete;
+  PainterState &operator=(const PainterState &) = delete;
+
+private:
+  QPainter &painter_;
+  const QPen pen_;
+  const QBrush brush_;
+  const bool antialiased_;
+};
+
+} // namespace
+
 namespace cvd {
 
 RenderArea::RenderArea(QWidget *const parent) : QWidget{parent} {
@@ -10,21 +39,43 @@ RenderArea::RenderArea(QWidget *const parent) : QWidget{parent} {
 }
 
 void RenderArea::paintEvent([[maybe_unused]] QPaintEvent *const event) {
-  drawEdges();
-  if (subjecsRefs_) {
-    for (const auto &subject : *subjecsRefs_) {
-      drawSubject(subject.pos, subject.radius, subject.status);
-    }
+  QPainter painter{this};
+  const auto &edgeColor = palette().dark().color();
+  if (edgePen_.color() != edgeColor) {
+    edgePen_ = QPen{edgeColor};
+  }
+  const auto &snapshot = snapshots_.read();
+  if (snapshot.compact) {
+    paint(painter, geometry(), edgePen_, snapshot.packed);
+  } else {
+    paint(painter, geometry(), edgePen_, snapshot.subjects);
+  }
+}
+
+void RenderArea::paint(QPainter &painter, const QRect &edges,
+                       const QPen &edgePen, const Subjects &subjects) {
+  const PainterState state{painter};
+  drawEdges(painter, edges, edgePen);
+  painter.setPen(QPen{});
+  for (const auto &subject : subjects) {
+    drawSubject(painter, subject.pos, subject.radius, subject.status);
   }
 }
 
-void RenderArea::drawEdges() {
-  const auto &rect = geometry();
+void RenderArea::paint(QPainter &painter, const QRect &edges,
+                       const QPen &edgePen, const CompactSubjects &subjects) {
+  const PainterState state{painter};
+  drawEdges(painter, edges, edgePen);
+  painter.setPen(QPen{});
+  for (auto i = size_t{0}; i < subjects.size(); ++i) {
+    drawSubject(painter, subjects.pos(i), subjects.radius(i),
+                subjects.status(i));
+  }
+}
 
-  QPainter painter{this};
-  painter.setPen(palette().dark().color());
-  painter.setBrush(Qt::SolidPattern);
-  painter.setRenderHint(QPainter::Antialiasing, true);
+void RenderArea::drawEdges(QPainter &painter, const QRect &rect,
+                           const QPen &pen) {
+  painter.setPen(pen);
 
   painter.drawLine(rect.bottomLeft(), rect.topLeft());
   painter.drawLine(rect.topLeft(), rect.topRight());
@@ -32,31 +83,38 @@ void RenderArea::drawEdges() {
   painter.drawLine(rect.bottomRight(), rect.bottomLeft());
 }
 
-void RenderArea::drawSubject(const QPointF &center, const float radius,
-                             const Subject::Status status) {
-  const auto &rect = geometry();
-
-  QPainter painter{this};
+void RenderArea::drawSubject(QPainter &painter, const QPointF &center,
+                             const float radius, const Subject::Status status) {
+  //! Built once, a brush per subject and paint would allocate every time
+  static const QBrush healthy{Qt::green, Qt::SolidPattern};
+  static const QBrush sick{Qt::red, Qt::SolidPattern};
+  static const QBrush recovered{Qt::blue, Qt::SolidPattern};
   switch (status) {
   case Subject::Status::Healthy:
-    painter.setBrush(QBrush{Qt::green, Qt::SolidPattern});
+    painter.setBrush(healthy);
     break;
   case Subject::Status::Sick:
-    painter.setBrush(QBrush{Qt::red, Qt::SolidPattern});
+    painter.setBrush(sick);
     break;
   case Subject::Status::Recovered:
-    painter.setBrush(QBrush{Qt::blue, Qt::SolidPattern});
+    painter.setBrush(recovered);
     break;
   default:
     assert(false);
   }
-  painter.setRenderHint(QPainter::Antialiasing, true);
   painter.drawEllipse(center, radius, radius);
 }
 
-void RenderArea::redraw(const std::shared_ptr<Subjects> &subjects) {
-  subjecsRefs_ = subjects;
+void RenderArea::redraw(const Subjects &subjects) {
+  snapshots_.back().assign(subjects, compact_);
+  snapshots_.publish();
   update();
 }
 
+void RenderArea::refresh() {
+  if (snapshots_.fresh()) {
+    update();
+  }
+}
+
 } // namespace cvd
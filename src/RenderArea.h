@@ -1,10 +1,14 @@
 #pragma once
 
+#include <QPen>
 #include <QWidget>
 
-#include <memory>
-
+#include "CompactSubjects.h"
+#include "Snapshot.h"
 #include "Subject.h"
+#include "TripleBuffer.h"
+
+class QPainter;
 
 namespace cvd {
 
@@ -12,17 +16,40 @@ class RenderArea final : public QWidget {
   Q_OBJECT
 public:
   explicit RenderArea(QWidget *parent = nullptr);
-  void redraw(const std::shared_ptr<Subjects> &subjects);
+  //! Publishes a copy of \p subjects and repaints, on the GUI thread.
+  void redraw(const Subjects &subjects);
+  //! Subjects painted by the widget, another thread may publish them
+  //! while it has the writing side to itself.
+  [[nodiscard]] TripleBuffer<Snapshot> &snapshots() { return snapshots_; }
+  //! Whether snapshots published from now on are packed, each of them
+  //! then takes a third of the memory. The simulation is not affected.
+  void setCompact(bool compact) { compact_ = compact; }
+  [[nodiscard]] bool compact() const { return compact_; }
+  //! Repaints if a newer snapshot was published.
+  void refresh();
+
+  //! Paints \p subjects inside \p edges the way the widget shows them, with
+  //! any painter, e.g. one on an offscreen image. \p edgePen is built by
+  //! the caller, so repainting with the same painter does not allocate.
+  static void paint(QPainter &painter, const QRect &edges,
+                    const QPen &edgePen, const Subjects &subjects);
+  static void paint(QPainter &painter, const QRect &edges,
+                    const QPen &edgePen, const CompactSubjects &subjects);
 
 protected:
   void paintEvent(QPaintEvent *event) override;
 
 private:
-  void drawEdges();
-  void drawSubject(const QPointF &center, float radius, Subject::Status status);
+  static void drawEdges(QPainter &painter, const QRect &rect,
+                        const QPen &pen);
+  static void drawSubject(QPainter &painter, const QPointF &center,
+                          float radius, Subject::Status status);
 
 private:
-  std::shared_ptr<Subjects> subjecsRefs_ = nullptr;
+  TripleBuffer<Snapshot> snapshots_;
+  bool compact_ = false;
+  //! Rebuilt when the palette changes only
+  QPen edgePen_;
 };
 
 } // namespace cvd
@@ -0,0 +1,1200 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+namespace {
+
+constexpr auto gDeltaT = 1.f;
+//! Neighbour lists reach that much of the nominal contact distance further,
+//! they stay valid until a subject moved half of it
+constexpr auto gSkinFactor = 0.5f;
+//! A substep moves subjects at most that much of the mean free path, the
+//! distance between contacts
+constexpr auto gFreePathFraction = 0.5;
+constexpr auto gMaxSubsteps = 16u;
+//! Crowding is counted on cells of that many typical contact distances,
+//! large enough to average out chance clusters, with at most that many
+//! cells along an axis
+constexpr auto gCrowdCellFactor = 16.f;
+constexpr auto gMaxCrowdCells = 1024.;
+//! Subjects, pairs or sick subjects per parallel chunk at least
+constexpr auto gChunkGrain = size_t{2048u};
+
+//! Number of ticks until a sick subject with \p sickTime left recovers,
+//! i.e. until the time left drops below zero.
+[[nodiscard]] uint64_t ticksToRecover(const float sickTime) {
+  assert(sickTime >= 0.f);
+  return static_cast<uint64_t>(std::floor(sickTime / gDeltaT)) + 1u;
+}
+
+constexpr auto gFixedOne = 65536.;
+
+[[nodiscard]] int32_t toFixed(const double value) {
+  return static_cast<int32_t>(std::lround(value * gFixedOne));
+}
+
+[[nodiscard]] double fromFixed(const int32_t value) {
+  return static_cast<double>(value) / gFixedOne;
+}
+
+//! Index of subjects dropped by a permutation
+constexpr auto gDropped = std::numeric_limits<uint32_t>::max();
+
+//! Spreads the low 16 bits of \p value to the even bits.
+[[nodiscard]] uint32_t spreadBits(uint32_t value) {
+  value &= 0xffffu;
+  value = (value | (value << 8u)) & 0x00ff00ffu;
+  value = (value | (value << 4u)) & 0x0f0f0f0fu;
+  value = (value | (value << 2u)) & 0x33333333u;
+  value = (value | (value << 1u)) & 0x55555555u;
+  return value;
+}
+
+//! Position on the Z-order curve through the bounds, 16 bits per axis.
+[[nodiscard]] uint32_t mortonCode(const QPointF &pos, const QRect &bounds) {
+  const auto quantize = [](const double value, const double origin,
+                           const double extent) {
+    const auto units = (value - origin) / std::max(extent, 1.) * 65535.;
+    return static_cast<uint32_t>(std::clamp(units, 0., 65535.));
+  };
+  return spreadBits(quantize(pos.x(), bounds.left(), bounds.width())) |
+         spreadBits(quantize(pos.y(), bounds.top(), bounds.height())) << 1u;
+}
+
+//! Mirrors \p value off the walls at \p low and \p high until it lies
+//! between them, as if it bounced along a straight line. Returns whether it
+//! ends up moving the other way.
+template <typename T>
+[[nodiscard]] bool reflect(T &value, const T low, const T high) {
+  if (high < low) {
+    value = low + (high - low) / 2;
+    return false;
+  }
+  auto reversed = false;
+  while (value < low || value > high) {
+    value = value < low ? 2 * low - value : 2 * high - value;
+    reversed = !reversed;
+  }
+  return reversed;
+}
+
+//! Smallest integer whose square is at least \p value.
+[[nodiscard]] int64_t ceilSqrt(const int64_t value) {
+  auto root = static_cast<int64_t>(std::sqrt(static_cast<double>(value)));
+  while (root * root < value) {
+    ++root;
+  }
+  while (root > 0 && (root - 1) * (root - 1) >= value) {
+    --root;
+  }
+  return root;
+}
+
+//! Bends of swept paths are located to that fraction of a substep
+constexpr auto gSweepUnits = int64_t{1} << 16;
+
+template <typename T> struct Point final {
+  T x;
+  T y;
+};
+
+//! Straight motion along one axis through a substep, mirrored off the walls
+//! at low and high the way reflect() mirrors it.
+template <typename T> struct Axis final {
+  T start;
+  T path;
+  T low;
+  T high;
+};
+
+[[nodiscard]] double floorDiv(const double value, const double divisor) {
+  return std::floor(value / divisor);
+}
+
+//! Rounds towards negative infinity, \p divisor has to be positive.
+[[nodiscard]] int64_t floorDiv(const int64_t value, const int64_t divisor) {
+  const auto quotient = value / divisor;
+  return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+template <typename T>
+[[nodiscard]] T ceilDiv(const T value, const T divisor) {
+  return -floorDiv(-value, divisor);
+}
+
+[[nodiscard]] double advance(const double start, const double path,
+                             const int64_t time) {
+  return start + path * (static_cast<double>(time) / gSweepUnits);
+}
+
+[[nodiscard]] int64_t advance(const int64_t start, const int64_t path,
+                              const int64_t time) {
+  return start + path * time / gSweepUnits;
+}
+
+//! Position at \p time, in gSweepUnits of the substep.
+template <typename T>
+[[nodiscard]] T position(const Axis<T> &axis, const int64_t time) {
+  auto value = advance(axis.start, axis.path, time);
+  static_cast<void>(reflect(value, axis.low, axis.high));
+  return value;
+}
+
+//! First time after \p time the axis hits a wall, rounded up to the units
+//! of the substep, gSweepUnits if it hits none before the substep ends.
+template <typename T>
+[[nodiscard]] int64_t nextBend(const Axis<T> &axis, const int64_t time) {
+  const auto units = static_cast<T>(gSweepUnits);
+  const auto width = axis.high - axis.low;
+  if (axis.path == T{0} || !(width > T{0})) {
+    return gSweepUnits;
+  }
+  //! Unfolded, the walls repeat every width. Scaled by the units, the
+  //! position at any time is exact in integers.
+  const auto offset = (axis.start - axis.low) * units +
+                      axis.path * static_cast<T>(time);
+  const auto forward = axis.path > T{0};
+  const auto wall = forward ? floorDiv(offset, width * units) + T{1}
+                            : ceilDiv(offset, width * units) - T{1};
+  const auto distance = (axis.low + wall * width - axis.start) * units;
+  const auto bend = forward ? ceilDiv(distance, axis.path)
+                            : ceilDiv(-distance, -axis.path);
+  if (!(bend < units)) {
+    return gSweepUnits;
+  }
+  return std::max(time + 1, static_cast<int64_t>(bend));
+}
+
+//! Whether moving from \p from to \p to relative to each other brings two
+//! subjects within \p reach, at the end or where the path passes closest.
+[[nodiscard]] bool touches(const Point<double> &from, const Point<double> &to,
+                           const double reach) {
+  const auto squaredReach = reach * reach;
+  if (to.x * to.x + to.y * to.y <= squaredReach) {
+    return true;
+  }
+  const auto pathX = to.x - from.x;
+  const auto pathY = to.y - from.y;
+  const auto approach = -(from.x * pathX + from.y * pathY);
+  const auto squaredPath = pathX * pathX + pathY * pathY;
+  if (approach <= 0. || approach >= squaredPath) {
+    return false;
+  }
+  const auto cross = from.x * pathY - from.y * pathX;
+  return cross * cross <= squaredReach * squaredPath;
+}
+
+[[nodiscard]] bool touches(const Point<int64_t> &from,
+                           const Point<int64_t> &to, const int64_t reach) {
+  if (to.x * to.x + to.y * to.y <= reach * reach) {
+    return true;
+  }
+  const auto pathX = to.x - from.x;
+  const auto pathY = to.y - from.y;
+  const auto approach = -(from.x * pathX + from.y * pathY);
+  const auto squaredPath = pathX * pathX + pathY * pathY;
+  if (approach <= 0 || approach >= squaredPath) {
+    return false;
+  }
+  //! The distance from the path is its cross product with the start over
+  //! the path length, compared without squaring to stay within 64 bits
+  const auto cross = from.x * pathY - from.y * pathX;
+  return std::abs(cross) <= reach * ceilSqrt(squaredPath);
+}
+
+//! Whether two subjects sweeping along the x and y \p axes of the first and
+//! then of the second come within \p reach. Between the bends of either
+//! both move straight, each piece is tested on its own.
+template <typename T>
+[[nodiscard]] bool swept(const std::array<Axis<T>, 4u> &axes, const T reach) {
+  const auto delta = [&axes](const int64_t time) {
+    return Point<T>{position(axes[0], time) - position(axes[2], time),
+                    position(axes[1], time) - position(axes[3], time)};
+  };
+  auto time = int64_t{0};
+  auto from = delta(time);
+  while (time < gSweepUnits) {
+    auto next = gSweepUnits;
+    for (const auto &axis : axes) {
+      next = std::min(next, nextBend(axis, time));
+    }
+    const auto to = delta(next);
+    if (touches(from, to, reach)) {
+      return true;
+    }
+    from = to;
+    time = next;
+  }
+  return false;
+}
+
+} // namespace
+
+namespace cvd {
+
+Simulation::Simulation(const Params &params, const QRect &bounds,
+                       std::shared_ptr<Subjects> subjects,
+                       const uint64_t ticks)
+    : params_{params}, bounds_{bounds}, subjects_{std::move(subjects)} {
+  assert(subjects_);
+  timers_.reset(ticks);
+  const auto frozenEnd = std::stable_partition(
+      subjects_->begin(), subjects_->end(),
+      [](const auto &subject) { return subject.freezed; });
+  frozenNumber_ = static_cast<size_t>(frozenEnd - subjects_->begin());
+  ids_.resize(subjects_->size());
+  std::iota(ids_.begin(), ids_.end(), 0u);
+  reservePopulation();
+
+  for (auto i = 0u; i < subjects_->size(); ++i) {
+    const auto &subject = (*subjects_)[i];
+    maxRadius_ = std::max(maxRadius_, subject.radius);
+    if (subject.status == Subject::Status::Sick) {
+      sick_.push_back(i);
+      timers_.schedule(ticks + ticksToRecover(subject.sickTimeRemaining), i,
+                       TimerWheel::Event::Recovery);
+    } else if (subject.status == Subject::Status::Recovered) {
+      ++recoveredNumber_;
+    }
+  }
+
+  if (params_.fixedPoint) {
+    fixed_.reserve(subjects_->size());
+    for (auto &subject : *subjects_) {
+      fixed_.push_back(toFixedMotion(subject));
+      //! Keep the mirrored positions exactly on the integer grid
+      subject.pos = QPointF{fromFixed(fixed_.back().x),
+                            fromFixed(fixed_.back().y)};
+    }
+  }
+
+  rebuildFrozenGrid();
+}
+
+void Simulation::step() {
+  infectedNumber_ = 0u;
+  fireTimers();
+  //! Nothing can spread or collide, skip building the grid
+  if (maxRadius_ <= 0.f || frozenNumber_ == subjects_->size() ||
+      (sick_.empty() && !params_.collisions)) {
+    substeps_ = 1u;
+    moveSubjects();
+    return;
+  }
+  if (reorderInterval_ > 0u && timers_.now() % reorderInterval_ == 0u) {
+    reorder();
+  }
+
+  substeps_ = chooseSubsteps();
+  infected_.clear();
+  for (auto substep = 0u; substep < substeps_; ++substep) {
+    moveSubjects(substep);
+    if (!neighboursValid() || movedTooFar()) {
+      buildNeighbours();
+    }
+    spreadInfection();
+    if (params_.collisions) {
+      collectContacts();
+      resolveContacts();
+    }
+  }
+
+  //! Infections are applied after the tick, so only subjects sick at its
+  //! beginning are contagious.
+  for (const auto id : infected_) {
+    if ((*subjects_)[id].status == Subject::Status::Healthy) {
+      infect(id);
+    }
+  }
+}
+
+const std::shared_ptr<Subjects> &Simulation::subjects() {
+  if (!positionsSynced_) {
+    //! Frozen subjects never move
+    for (auto id = frozenNumber_; id < subjects_->size(); ++id) {
+      (*subjects_)[id].pos = position(static_cast<uint32_t>(id));
+    }
+    positionsSynced_ = true;
+  }
+  return subjects_;
+}
+
+void Simulation::setCollisions(const bool enabled) {
+  params_.collisions = enabled;
+}
+
+void Simulation::setRadius(const float radius) {
+  //! Radii drawn around the previous radius are scaled along
+  const auto scale = params_.radius > 0.f ? radius / params_.radius : 0.f;
+  params_.radius = radius;
+  maxRadius_ = 0.f;
+  for (auto id = 0u; id < subjects_->size(); ++id) {
+    auto &subject = (*subjects_)[id];
+    subject.radius = scale > 0.f ? subject.radius * scale : radius;
+    maxRadius_ = std::max(maxRadius_, subject.radius);
+    if (params_.fixedPoint) {
+      fixed_[id].radius = toFixed(subject.radius);
+    }
+  }
+  //! Cell sizes follow the radii
+  rebuildFrozenGrid();
+}
+
+void Simulation::setMinimalSpeed(const float minimalSpeed) {
+  assert(params_.minimalSpeed > 0.f && minimalSpeed > 0.f);
+  const auto scale = minimalSpeed / params_.minimalSpeed;
+  params_.minimalSpeed = minimalSpeed;
+  //! Frozen subjects keep their speed for when they are released
+  for (auto id = frozenNumber_; id < subjects_->size(); ++id) {
+    auto &subject = (*subjects_)[id];
+    subject.speed *= scale;
+    if (params_.fixedPoint) {
+      const auto velocity = subject.direction * subject.speed * gDeltaT;
+      fixed_[id].vx = toFixed(velocity.x());
+      fixed_[id].vy = toFixed(velocity.y());
+    }
+  }
+}
+
+void Simulation::setSickTime(const float sickTime) {
+  assert(params_.sickTime > 0.f && sickTime >= 0.f);
+  const auto scale = static_cast<double>(sickTime / params_.sickTime);
+  params_.sickTime = sickTime;
+  const auto now = timers_.now();
+  rescheduleTimers([scale, now](TimerWheel::Timer &timer) {
+    const auto left = static_cast<double>(timer.due - now);
+    timer.due =
+        now + static_cast<uint64_t>(std::max(1., std::round(left * scale)));
+  });
+}
+
+void Simulation::addSubjects(const Subjects &subjects) {
+  const auto ticks = timers_.now();
+  for (const auto &subject : subjects) {
+    assert(!subject.freezed);
+    const auto id = static_cast<uint32_t>(subjects_->size());
+    subjects_->push_back(subject);
+    //! Ids are dense, the next one is the population size
+    ids_.push_back(id);
+    if (params_.fixedPoint) {
+      fixed_.push_back(toFixedMotion(subject));
+      subjects_->back().pos = QPointF{fromFixed(fixed_.back().x),
+                                      fromFixed(fixed_.back().y)};
+    }
+    if (subject.status == Subject::Status::Sick) {
+      sick_.push_back(id);
+      timers_.schedule(ticks + ticksToRecover(subject.sickTimeRemaining), id,
+                       TimerWheel::Event::Recovery);
+    } else if (subject.status == Subject::Status::Recovered) {
+      ++recoveredNumber_;
+    }
+  }
+  params_.number = subjects_->size();
+  reservePopulation();
+  invalidateNeighbours();
+
+  const auto skin = this->skin();
+  maxRadius_ = std::accumulate(
+      subjects.begin(), subjects.end(), maxRadius_,
+      [](const float radius, const Subject &subject) {
+        return std::max(radius, subject.radius);
+      });
+  //! Frozen subjects are indexed by their reach, which includes the skin
+  if (this->skin() != skin) {
+    rebuildFrozenGrid();
+  }
+}
+
+void Simulation::removeSubjects(const size_t number) {
+  assert(number <= subjects_->size());
+  const auto size = subjects_->size() - number;
+  const auto &subjects = *subjects_;
+  order_.clear();
+  auto frozenNumber = size_t{0u};
+  for (auto index = 0u; index < subjects.size(); ++index) {
+    if (ids_[index] < size) {
+      order_.push_back(index);
+      frozenNumber += index < frozenNumber_ ? 1u : 0u;
+    } else if (subjects[index].status == Subject::Status::Recovered) {
+      --recoveredNumber_;
+    }
+  }
+  //! Kept subjects stay in order, the frozen prefix only shifts if some
+  //! of it is removed
+  permute(order_);
+  params_.number = size;
+  if (frozenNumber != frozenNumber_) {
+    frozenNumber_ = frozenNumber;
+    rebuildFrozenGrid();
+  }
+}
+
+void Simulation::syncSickTime() {
+  timers_.forEach([this](const TimerWheel::Timer &timer) {
+    if (timer.event == TimerWheel::Event::Recovery) {
+      //! Inverse of ticksToRecover
+      const auto ticksLeft = timer.due - timers_.now() - 1u;
+      (*subjects_)[timer.subject].sickTimeRemaining =
+          static_cast<float>(ticksLeft) * gDeltaT;
+    }
+  });
+}
+
+void Simulation::reservePopulation() {
+  const auto size = subjects_->size();
+  sick_.reserve(size);
+  infected_.reserve(size);
+  rescheduled_.reserve(size);
+  timers_.reserve(size);
+}
+
+Statistics Simulation::statistics() const {
+  const auto total = subjects_->size();
+  return Statistics{
+      total - sick_.size() - recoveredNumber_,
+      sick_.size(),
+      recoveredNumber_,
+      infectedNumber_,
+  };
+}
+
+void Simulation::fireTimers() {
+  auto recovered = false;
+  timers_.advance([this, &recovered](const TimerWheel::Timer &timer) {
+    auto &subject = (*subjects_)[timer.subject];
+    switch (timer.event) {
+    case TimerWheel::Event::Recovery:
+      assert(subject.status == Subject::Status::Sick);
+      subject.status = Subject::Status::Recovered;
+      subject.sickTimeRemaining = -1.f;
+      ++recoveredNumber_;
+      recovered = true;
+      break;
+    default:
+      assert(false);
+    }
+  });
+
+  if (recovered) {
+    sick_.erase(std::remove_if(sick_.begin(), sick_.end(),
+                               [this](const uint32_t id) {
+                                 return (*subjects_)[id].status !=
+                                        Subject::Status::Sick;
+                               }),
+                sick_.end());
+  }
+}
+
+uint32_t Simulation::chooseSubsteps() {
+  const auto diameter = 2.f * std::min(params_.radius, maxRadius_);
+  if (diameter <= 0.f) {
+    return 1u;
+  }
+  const auto &subjects = *subjects_;
+  auto maxPath = 0.;
+  for (auto id = frozenNumber_; id < subjects.size(); ++id) {
+    if (params_.fixedPoint) {
+      const auto vx = static_cast<int64_t>(fixed_[id].vx);
+      const auto vy = static_cast<int64_t>(fixed_[id].vy);
+      const auto path = ceilSqrt(vx * vx + vy * vy);
+      maxPath = std::max(maxPath, fromFixed(static_cast<int32_t>(path)));
+    } else {
+      maxPath =
+          std::max(maxPath, static_cast<double>(subjects[id].speed * gDeltaT));
+    }
+  }
+
+  const auto width = static_cast<double>(std::max(bounds_.width(), 1));
+  const auto height = static_cast<double>(std::max(bounds_.height(), 1));
+  const auto cellSize =
+      std::max(static_cast<double>(gCrowdCellFactor * diameter),
+               std::max(width, height) / gMaxCrowdCells);
+  //! A subject sweeps twice the contact distance per unit of path
+  const auto substeps = [&](const double crowding) {
+    const auto freePath =
+        cellSize * cellSize / (2. * static_cast<double>(diameter) * crowding);
+    return std::ceil(maxPath / (gFreePathFraction * freePath));
+  };
+  //! Everybody in one cell is as crowded as it gets, slow runs do not need
+  //! the crowd counted then
+  if (substeps(static_cast<double>(subjects.size())) <= 1.) {
+    return 1u;
+  }
+
+  const auto columns = static_cast<size_t>(width / cellSize) + 1u;
+  const auto rows = static_cast<size_t>(height / cellSize) + 1u;
+  const auto cell = [cellSize](const double offset, const size_t cells) {
+    return static_cast<size_t>(
+        std::clamp(offset / cellSize, 0., static_cast<double>(cells - 1u)));
+  };
+
+  //! Frozen subjects crowd the moving ones as well
+  crowd_.assign(columns * rows, 0u);
+  auto crowding = 1u;
+  for (auto id = 0u; id < subjects.size(); ++id) {
+    const auto pos = position(id);
+    const auto column = cell(pos.x() - bounds_.left(), columns);
+    const auto row = cell(pos.y() - bounds_.top(), rows);
+    crowding = std::max(crowding, ++crowd_[row * columns + column]);
+  }
+  return static_cast<uint32_t>(std::clamp(substeps(crowding), 1.,
+                                          static_cast<double>(gMaxSubsteps)));
+}
+
+void Simulation::moveSubjects(const uint32_t substep) {
+  if (params_.fixedPoint) {
+    moveFixedSubjects(substep);
+    return;
+  }
+
+  const auto deltaT = gDeltaT / static_cast<float>(substeps_);
+  startPos_.resize(subjects_->size());
+  path_.resize(subjects_->size());
+  const auto move = [this, deltaT](size_t, const size_t first,
+                                   const size_t last) {
+    for (auto id = frozenNumber_ + first; id < frozenNumber_ + last; ++id) {
+      auto &subject = (*subjects_)[id];
+      auto &pos = subject.pos;
+      auto &direction = subject.direction;
+      const auto &speed = subject.speed;
+      const auto radius = static_cast<double>(subject.radius);
+      startPos_[id] = pos;
+      path_[id] = QPointF{
+          direction.x() * speed * deltaT,
+          direction.y() * speed * deltaT,
+      };
+
+      auto newPos = pos + path_[id];
+
+      //! Detect edges collisions
+      {
+        if (reflect(newPos.rx(), bounds_.left() + radius,
+                    bounds_.right() - radius)) {
+          direction.setX(-1.f * direction.x());
+        }
+
+        if (reflect(newPos.ry(), bounds_.top() + radius,
+                    bounds_.bottom() - radius)) {
+          direction.setY(-1.f * direction.y());
+        }
+      }
+      pos = newPos;
+    }
+  };
+  parallelFor(subjects_->size() - frozenNumber_, move);
+}
+
+void Simulation::moveFixedSubjects(const uint32_t substep) {
+  const auto left = toFixed(bounds_.left());
+  const auto right = toFixed(bounds_.right());
+  const auto top = toFixed(bounds_.top());
+  const auto bottom = toFixed(bounds_.bottom());
+
+  auto &subjects = *subjects_;
+  positionsSynced_ = false;
+  const auto move = [&, substep](size_t, const size_t first,
+                                 const size_t last) {
+    for (auto id = frozenNumber_ + first; id < frozenNumber_ + last; ++id) {
+      auto &motion = fixed_[id];
+      //! The substeps' shares of the velocity add up to it exactly, and a
+      //! reversed velocity has the opposite shares
+      const auto share = [substep, substeps = substeps_](const int32_t v) {
+        if (substeps == 1u) {
+          return v;
+        }
+        const auto velocity = static_cast<int64_t>(v);
+        return static_cast<int32_t>(velocity * (substep + 1u) / substeps -
+                                    velocity * substep / substeps);
+      };
+      motion.start = FixedPoint{motion.x, motion.y};
+      motion.path = FixedPoint{share(motion.vx), share(motion.vy)};
+      auto x = motion.x + motion.path.x;
+      auto y = motion.y + motion.path.y;
+
+      //! Detect edges collisions, the direction is mirrored as well, so
+      //! the integer velocity can be restored from it
+      {
+        if (reflect(x, left + motion.radius, right - motion.radius)) {
+          motion.vx = -motion.vx;
+          auto &direction = subjects[id].direction;
+          direction.setX(-1.f * direction.x());
+        }
+
+        if (reflect(y, top + motion.radius, bottom - motion.radius)) {
+          motion.vy = -motion.vy;
+          auto &direction = subjects[id].direction;
+          direction.setY(-1.f * direction.y());
+        }
+      }
+      motion.x = x;
+      motion.y = y;
+    }
+  };
+  parallelFor(subjects.size() - frozenNumber_, move);
+}
+
+Simulation::FixedMotion
+Simulation::toFixedMotion(const Subject &subject) const {
+  const auto velocity = subject.direction * subject.speed * gDeltaT;
+  const auto x = toFixed(subject.pos.x());
+  const auto y = toFixed(subject.pos.y());
+  return FixedMotion{
+      x,
+      y,
+      toFixed(velocity.x()),
+      toFixed(velocity.y()),
+      toFixed(subject.radius),
+      FixedPoint{x, y},
+      FixedPoint{0, 0},
+  };
+}
+
+QPointF Simulation::position(const uint32_t id) const {
+  if (params_.fixedPoint) {
+    return QPointF{fromFixed(fixed_[id].x), fromFixed(fixed_[id].y)};
+  }
+  return (*subjects_)[id].pos;
+}
+
+void Simulation::rebuildFrozenGrid() {
+  const auto &subjects = *subjects_;
+  const auto skin = this->skin();
+  reach_.resize(subjects.size());
+  for (auto id = 0u; id < frozenNumber_; ++id) {
+    reach_[id] = 2.f * subjects[id].radius + skin;
+  }
+  frozenGrid_.rebuild([this](const uint32_t id) { return position(id); },
+                      0u, frozenNumber_, bounds_, reach_);
+  invalidateNeighbours();
+}
+
+float Simulation::skin() const {
+  return 2.f * gSkinFactor * std::min(params_.radius, maxRadius_);
+}
+
+bool Simulation::movedTooFar() const {
+  const auto &subjects = *subjects_;
+  const auto limit = static_cast<double>(skin()) / 2.;
+  if (params_.fixedPoint) {
+    return movedTooFarFixed(limit);
+  }
+  const auto squaredLimit = limit * limit;
+  const auto tooFar = [squaredLimit](const QPointF &delta) {
+    return delta.x() * delta.x() + delta.y() * delta.y() > squaredLimit;
+  };
+  //! A bounce returns a subject to its start, the whole path of the tick
+  //! has to stay within the lists' reach
+  std::atomic_bool moved{false};
+  const auto check = [&](size_t, const size_t first, const size_t last) {
+    auto chunkMoved = false;
+    for (auto id = frozenNumber_ + first; id < frozenNumber_ + last; ++id) {
+      const auto id32 = static_cast<uint32_t>(id);
+      if (bounced(id32)) {
+        //! Bends on the walls lie within the path length of the start
+        const auto offset = startPos_[id] - builtPos_[id];
+        const auto &path = path_[id];
+        chunkMoved |= std::hypot(offset.x(), offset.y()) +
+                          std::hypot(path.x(), path.y()) >
+                      limit;
+      } else {
+        chunkMoved |= tooFar(subjects[id].pos - builtPos_[id]) ||
+                      tooFar(startPos_[id] - builtPos_[id]);
+      }
+    }
+    if (chunkMoved) {
+      moved.store(true, std::memory_order_relaxed);
+    }
+  };
+  parallelFor(subjects.size() - frozenNumber_, check);
+  return moved.load(std::memory_order_relaxed);
+}
+
+bool Simulation::movedTooFarFixed(const double limit) const {
+  //! Rounded down, the lists expire rather early than late
+  const auto fixedLimit = static_cast<int64_t>(std::floor(limit * gFixedOne));
+  const auto squaredLimit = fixedLimit * fixedLimit;
+  const auto squared = [](const int64_t x, const int64_t y) {
+    return x * x + y * y;
+  };
+  std::atomic_bool moved{false};
+  const auto check = [&](size_t, const size_t first, const size_t last) {
+    auto chunkMoved = false;
+    for (auto id = frozenNumber_ + first; id < frozenNumber_ + last; ++id) {
+      const auto &motion = fixed_[id];
+      const auto &built = builtFixed_[id];
+      const auto startX = static_cast<int64_t>(motion.start.x) - built.x;
+      const auto startY = static_cast<int64_t>(motion.start.y) - built.y;
+      if (bounced(static_cast<uint32_t>(id))) {
+        //! Bends on the walls lie within the path length of the start,
+        //! square roots are rounded up
+        const auto offset = ceilSqrt(squared(startX, startY));
+        const auto path = ceilSqrt(squared(motion.path.x, motion.path.y));
+        chunkMoved |= offset + path > fixedLimit;
+      } else {
+        chunkMoved |=
+            squared(static_cast<int64_t>(motion.x) - built.x,
+                    static_cast<int64_t>(motion.y) - built.y) > squaredLimit ||
+            squared(startX, startY) > squaredLimit;
+      }
+    }
+    if (chunkMoved) {
+      moved.store(true, std::memory_order_relaxed);
+    }
+  };
+  parallelFor(fixed_.size() - frozenNumber_, check);
+  return moved.load(std::memory_order_relaxed);
+}
+
+void Simulation::buildNeighbours() {
+  const auto &subjects = *subjects_;
+  const auto size = subjects.size();
+  const auto skin = this->skin();
+  //! Subjects meeting within this tick are at most their path lengths
+  //! further apart at its end, the skin covers short paths
+  reach_.resize(size);
+  const auto reach = [&](size_t, const size_t first, const size_t last) {
+    for (auto id = frozenNumber_ + first; id < frozenNumber_ + last; ++id) {
+      //! Unreflected, a bounce does not shorten it
+      const auto path =
+          params_.fixedPoint
+              ? QPointF{fromFixed(fixed_[id].path.x),
+                        fromFixed(fixed_[id].path.y)}
+              : path_[id];
+      const auto length = static_cast<float>(std::hypot(path.x(), path.y()));
+      reach_[id] = 2.f * subjects[id].radius + std::max(skin, 2.f * length);
+    }
+  };
+  parallelFor(size - frozenNumber_, reach);
+  pairs_.clear();
+  //! Instantiated per mode, the pair loops do not branch on it
+  const auto collectPairs = [&](const auto &position, const auto &delta) {
+    grid_.rebuild(position, frozenNumber_, size, bounds_, reach_);
+    const auto near = [this, &delta](const uint32_t a, const uint32_t b,
+                                     std::vector<Contact> &pairs) {
+      const auto offset = delta(a, b);
+      const auto distance = static_cast<double>(reach_[a] + reach_[b]) / 2.;
+      if (offset.x() * offset.x() + offset.y() * offset.y() <=
+          distance * distance) {
+        pairs.push_back(Contact{std::min(a, b), std::max(a, b)});
+      }
+    };
+    grid_.forEachPair([this, &near](const uint32_t a, const uint32_t b) {
+      near(a, b, pairs_);
+    });
+    //! Frozen subjects never meet each other
+    if (frozenNumber_ > 0u) {
+      const auto nearFrozen = [&](const size_t first, const size_t last,
+                                  std::vector<Contact> &pairs) {
+        for (auto index = frozenNumber_ + first; index < frozenNumber_ + last;
+             ++index) {
+          const auto id = static_cast<uint32_t>(index);
+          frozenGrid_.forEachNear(
+              position(id), reach_[id],
+              [&near, &pairs, id](const uint32_t frozenId) {
+                near(id, frozenId, pairs);
+              });
+        }
+      };
+      gather(size - frozenNumber_, chunkPairs_, pairs_, nearFrozen);
+    }
+  };
+  if (params_.fixedPoint) {
+    //! Packed a third as large as the motion, candidate pairs are looked
+    //! up at random and miss the cache less
+    builtFixed_.resize(size);
+    for (auto id = size_t{0u}; id < size; ++id) {
+      builtFixed_[id] = FixedPoint{fixed_[id].x, fixed_[id].y};
+    }
+    collectPairs(
+        [this](const uint32_t id) {
+          const auto &pos = builtFixed_[id];
+          return QPointF{fromFixed(pos.x), fromFixed(pos.y)};
+        },
+        [this](const uint32_t a, const uint32_t b) {
+          const auto &first = builtFixed_[a];
+          const auto &second = builtFixed_[b];
+          return QPointF{
+              static_cast<double>(static_cast<int64_t>(first.x) - second.x) /
+                  gFixedOne,
+              static_cast<double>(static_cast<int64_t>(first.y) - second.y) /
+                  gFixedOne,
+          };
+        });
+  } else {
+    collectPairs(
+        [&subjects](const uint32_t id) { return subjects[id].pos; },
+        [&subjects](const uint32_t a, const uint32_t b) {
+          return subjects[a].pos - subjects[b].pos;
+        });
+  }
+  //! Grid traversal order depends on positions, contacts are resolved in
+  //! index order
+  std::sort(pairs_.begin(), pairs_.end(),
+            [](const Contact &lhs, const Contact &rhs) {
+              return std::tie(lhs.first, lhs.second) <
+                     std::tie(rhs.first, rhs.second);
+            });
+
+  //! Both directions of every pair as one flat array with per-subject
+  //! offsets, for the sick subjects to look up their neighbours
+  neighbourStart_.assign(size + 1u, 0u);
+  for (const auto &pair : pairs_) {
+    ++neighbourStart_[pair.first + 1u];
+    ++neighbourStart_[pair.second + 1u];
+  }
+  std::partial_sum(neighbourStart_.begin(), neighbourStart_.end(),
+                   neighbourStart_.begin());
+  //! Pair counts drift around a plateau for the whole run, doubled once
+  //! they fill half of it the room only grows again when they double, not
+  //! whenever the drift crosses a power of two. Contacts and neighbours are
+  //! sized after it.
+  if (2u * pairs_.size() > pairs_.capacity()) {
+    pairs_.reserve(std::max(2u * pairs_.size(), 2u * pairs_.capacity()));
+  }
+  neighbours_.reserve(2u * pairs_.capacity());
+  neighbours_.resize(2u * pairs_.size());
+  cursor_.assign(neighbourStart_.begin(), neighbourStart_.end() - 1);
+  for (const auto &pair : pairs_) {
+    neighbours_[cursor_[pair.first]++] = pair.second;
+    neighbours_[cursor_[pair.second]++] = pair.first;
+  }
+
+  if (!params_.fixedPoint) {
+    builtPos_.resize(size);
+    for (auto id = frozenNumber_; id < size; ++id) {
+      builtPos_[id] = subjects[id].pos;
+    }
+  }
+  neighboursBuilt_ = true;
+}
+
+template <typename Body>
+void Simulation::parallelFor(const size_t count, Body &&body) const {
+  if (scheduler_ != nullptr) {
+    scheduler_->parallelFor(count, gChunkGrain, body);
+  } else if (count > 0u) {
+    body(size_t{0u}, size_t{0u}, count);
+  }
+}
+
+//! Results of each chunk are collected apart and appended in chunk order,
+//! the same order a single pass would produce.
+template <typename T, typename Collect>
+void Simulation::gather(const size_t count,
+                        std::vector<std::vector<T>> &parts,
+                        std::vector<T> &result, Collect &&collect) {
+  const auto chunks =
+      scheduler_ != nullptr ? scheduler_->chunks(count, gChunkGrain) : 1u;
+  if (chunks == 1u) {
+    collect(size_t{0u}, count, result);
+    return;
+  }
+  //! Never shrunk, the parts keep their capacity for later ticks
+  if (parts.size() < chunks) {
+    parts.resize(chunks);
+  }
+  for (auto chunk = size_t{0u}; chunk < chunks; ++chunk) {
+    parts[chunk].clear();
+  }
+  const auto run = [&parts, &collect](const size_t chunk, const size_t first,
+                                      const size_t last) {
+    collect(first, last, parts[chunk]);
+  };
+  parallelFor(count, run);
+
+  //! Chunks take turns peaking, as large as the largest part one growth
+  //! covers all of them
+  auto size = result.size();
+  auto room = size_t{0u};
+  for (auto chunk = size_t{0u}; chunk < chunks; ++chunk) {
+    size += parts[chunk].size();
+    room = std::max(room, parts[chunk].capacity());
+  }
+  for (auto chunk = size_t{0u}; chunk < chunks; ++chunk) {
+    parts[chunk].reserve(room);
+  }
+  //! Grown geometrically, inserting into an emptied vector would only make
+  //! room for the exact size and reallocate whenever it creeps up
+  if (size > result.capacity()) {
+    result.reserve(std::max(size, 2u * result.capacity()));
+  }
+  for (auto chunk = size_t{0u}; chunk < chunks; ++chunk) {
+    result.insert(result.end(), parts[chunk].begin(), parts[chunk].end());
+  }
+}
+
+//! Re-inserts every pending timer as changed by \p update, a due tick of
+//! zero drops the timer.
+template <typename Update> void Simulation::rescheduleTimers(Update &&update) {
+  rescheduled_.clear();
+  timers_.forEach([this](const TimerWheel::Timer &timer) {
+    rescheduled_.push_back(timer);
+  });
+  timers_.reset(timers_.now());
+  for (auto &timer : rescheduled_) {
+    update(timer);
+    if (timer.due != 0u) {
+      timers_.schedule(timer.due, timer.subject, timer.event);
+    }
+  }
+}
+
+void Simulation::reorder() {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  const auto &subjects = *subjects_;
+  const auto size = subjects.size();
+  const auto first = frozenOrdered_ ? frozenNumber_ : size_t{0u};
+
+  //! Code in the high half and index in the low half, sorting the plain
+  //! integers keeps subjects with equal codes in index order
+  keys_.resize(size);
+  for (auto index = first; index < size; ++index) {
+    keys_[index] = uint64_t{mortonCode(position(static_cast<uint32_t>(index)),
+                                   bounds_)} << 32u |
+                   index;
+  }
+  const auto frozenEnd =
+      keys_.begin() + static_cast<ptrdiff_t>(frozenNumber_);
+  if (!frozenOrdered_) {
+    std::sort(keys_.begin(), frozenEnd);
+  }
+  std::sort(frozenEnd, keys_.end());
+
+  order_.resize(size);
+  std::iota(order_.begin(), order_.begin() + static_cast<ptrdiff_t>(first),
+            0u);
+  for (auto index = first; index < size; ++index) {
+    order_[index] = static_cast<uint32_t>(keys_[index]);
+  }
+  permute(order_);
+  if (!frozenOrdered_) {
+    frozenOrdered_ = true;
+    rebuildFrozenGrid();
+  }
+
+  reorderCost_.last = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - start);
+  reorderCost_.total += reorderCost_.last;
+  ++reorderCost_.reorders;
+}
+
+void Simulation::permute(const std::vector<uint32_t> &order) {
+  auto &subjects = *subjects_;
+  indexOf_.assign(subjects.size(), gDropped);
+  permuted_.clear();
+  permutedIds_.clear();
+  permutedFixed_.clear();
+  permutedStartPos_.clear();
+  if (!params_.fixedPoint) {
+    startPos_.resize(subjects.size());
+  }
+  for (auto index = 0u; index < order.size(); ++index) {
+    const auto previous = order[index];
+    indexOf_[previous] = index;
+    permuted_.push_back(subjects[previous]);
+    permutedIds_.push_back(ids_[previous]);
+    if (params_.fixedPoint) {
+      permutedFixed_.push_back(fixed_[previous]);
+    } else {
+      permutedStartPos_.push_back(startPos_[previous]);
+    }
+  }
+  //! The old buffers are kept as scratch for the next permutation
+  subjects.swap(permuted_);
+  ids_.swap(permutedIds_);
+  if (params_.fixedPoint) {
+    fixed_.swap(permutedFixed_);
+  } else {
+    startPos_.swap(permutedStartPos_);
+  }
+
+  for (auto &id : sick_) {
+    id = indexOf_[id];
+  }
+  invalidateNeighbours();
+  sick_.erase(std::remove(sick_.begin(), sick_.end(), gDropped), sick_.end());
+  rescheduleTimers([this](TimerWheel::Timer &timer) {
+    timer.subject = indexOf_[timer.subject];
+    if (timer.subject == gDropped) {
+      timer.due = 0u;
+    }
+  });
+}
+
+bool Simulation::met(const uint32_t a, const uint32_t b) const {
+  const auto straight = !bounced(a) && !bounced(b);
+
+  //! Relative to each other the subjects move from the start delta to the
+  //! end delta, unless one of them bounced off a wall on the way
+  if (params_.fixedPoint) {
+    //! Frozen subjects start where they stay, with an empty path
+    const auto &first = fixed_[a];
+    const auto &second = fixed_[b];
+    const auto reach = static_cast<int64_t>(first.radius) + second.radius;
+    if (straight) {
+      return touches(
+          Point<int64_t>{static_cast<int64_t>(first.start.x) - second.start.x,
+                         static_cast<int64_t>(first.start.y) - second.start.y},
+          Point<int64_t>{static_cast<int64_t>(first.x) - second.x,
+                         static_cast<int64_t>(first.y) - second.y},
+          reach);
+    }
+    const auto left = static_cast<int64_t>(toFixed(bounds_.left()));
+    const auto right = static_cast<int64_t>(toFixed(bounds_.right()));
+    const auto top = static_cast<int64_t>(toFixed(bounds_.top()));
+    const auto bottom = static_cast<int64_t>(toFixed(bounds_.bottom()));
+    const auto axes = [&](const FixedMotion &motion) {
+      const auto radius = static_cast<int64_t>(motion.radius);
+      return std::array{
+          Axis<int64_t>{motion.start.x, motion.path.x, left + radius,
+                        right - radius},
+          Axis<int64_t>{motion.start.y, motion.path.y, top + radius,
+                        bottom - radius},
+      };
+    };
+    const auto [firstX, firstY] = axes(first);
+    const auto [secondX, secondY] = axes(second);
+    return swept(std::array{firstX, firstY, secondX, secondY}, reach);
+  }
+
+  const auto &subjects = *subjects_;
+  //! Frozen subjects never moved, their start and path are not tracked
+  const auto start = [this, &subjects](const uint32_t id) {
+    return id < frozenNumber_ ? subjects[id].pos : startPos_[id];
+  };
+  const auto path = [this](const uint32_t id) {
+    return id < frozenNumber_ ? QPointF{} : path_[id];
+  };
+
+  const auto reach =
+      static_cast<double>(subjects[a].radius + subjects[b].radius);
+  if (straight) {
+    const auto startDelta = start(a) - start(b);
+    const auto delta = subjects[a].pos - subjects[b].pos;
+    return touches(Point<double>{startDelta.x(), startDelta.y()},
+                   Point<double>{delta.x(), delta.y()}, reach);
+  }
+  const auto axes = [&](const uint32_t id) {
+    const auto radius = static_cast<double>(subjects[id].radius);
+    const auto from = start(id);
+    const auto along = path(id);
+    return std::array{
+        Axis<double>{from.x(), along.x(), bounds_.left() + radius,
+                     bounds_.right() - radius},
+        Axis<double>{from.y(), along.y(), bounds_.top() + radius,
+                     bounds_.bottom() - radius},
+    };
+  };
+  const auto [firstX, firstY] = axes(a);
+  const auto [secondX, secondY] = axes(b);
+  return swept(std::array{firstX, firstY, secondX, secondY}, reach);
+}
+
+bool Simulation::bounced(const uint32_t id) const {
+  if (id < frozenNumber_) {
+    return false;
+  }
+  //! The move added the path to the start just the same, a subject ends
+  //! anywhere else only if a wall reflected it
+  if (params_.fixedPoint) {
+    const auto &motion = fixed_[id];
+    return motion.start.x + motion.path.x != motion.x ||
+           motion.start.y + motion.path.y != motion.y;
+  }
+  const auto end = startPos_[id] + path_[id];
+  const auto &pos = (*subjects_)[id].pos;
+  return end.x() != pos.x() || end.y() != pos.y();
+}
+
+void Simulation::bounce(const uint32_t id) {
+  auto &subject = (*subjects_)[id];
+  auto &direction = subject.direction;
+  direction.setX(-1.f * direction.x());
+  direction.setY(-1.f * direction.y());
+  if (subject.freezed) {
+    return;
+  }
+
+  if (params_.fixedPoint) {
+    auto &motion = fixed_[id];
+    motion.vx = -motion.vx;
+    motion.vy = -motion.vy;
+    motion.x = motion.start.x;
+    motion.y = motion.start.y;
+    return;
+  }
+  subject.pos = startPos_[id];
+}
+
+void Simulation::spreadInfection() {
+  const auto &subjects = *subjects_;
+  const auto spread = [this, &subjects](const size_t first, const size_t last,
+                                        std::vector<uint32_t> &infected) {
+    for (auto index = first; index < last; ++index) {
+      const auto id = sick_[index];
+      for (auto i = neighbourStart_[id]; i < neighbourStart_[id + 1u]; ++i) {
+        const auto otherId = neighbours_[i];
+        if (subjects[otherId].status == Subject::Status::Healthy &&
+            met(id, otherId)) {
+          infected.push_back(otherId);
+        }
+      }
+    }
+  };
+  gather(sick_.size(), chunkInfected_, infected_, spread);
+}
+
+void Simulation::infect(const uint32_t id) {
+  auto &subject = (*subjects_)[id];
+  subject.status = Subject::Status::Sick;
+  subject.sickTimeRemaining = params_.sickTime;
+  sick_.push_back(id);
+  ++infectedNumber_;
+  timers_.schedule(timers_.now() + ticksToRecover(params_.sickTime), id,
+                   TimerWheel::Event::Recovery);
+}
+
+void Simulation::collectContacts() {
+  contacts_.clear();
+  //! A subset of the pairs, a handful of contacts would otherwise grow it
+  //! in small steps far into the run
+  contacts_.reserve(pairs_.capacity());
+  //! Pairs are sorted, so are the contacts
+  const auto collect = [this](const size_t first, const size_t last,
+                              std::vector<Contact> &contacts) {
+    //! Never more than the pairs, room for all of them keeps a chunk from
+    //! growing whenever its contacts peak. Chunks span a grain unless the
+    //! scheduler runs out of them, at least that much room keeps them from
+    //! growing whenever the pair count shifts their bounds.
+    const auto most = contacts.size() + (last - first);
+    if (most > contacts.capacity()) {
+      contacts.reserve(
+          std::max({most, 2u * contacts.capacity(), gChunkGrain}));
+    }
+    for (auto index = first; index < last; ++index) {
+      const auto &pair = pairs_[index];
+      if (met(pair.first, pair.second)) {
+        contacts.push_back(pair);
+      }
+    }
+  };
+  gather(pairs_.size(), chunkPairs_, contacts_, collect);
+}
+
+void Simulation::resolveContacts() {
+  for (const auto &contact : contacts_) {
+    bounce(contact.first);
+    bounce(contact.second);
+  }
+}
+
+} // namespace cvd
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <QRect>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Params.h"
+#include "LevelGrid.h"
+#include "Statistics.h"
+#include "Subject.h"
+#include "TaskScheduler.h"
+#include "TimerWheel.h"
+
+namespace cvd {
+
+//! Subjects are kept with the frozen ones first, those never move and are
+//! indexed once by a static grid, only the moving tail is re-indexed when
+//! the neighbour lists expire.
+//!
+//! In fixed point mode motion is integrated on 16.16 integer positions and
+//! velocities, and contacts are tested on integer squared distances, so a
+//! run is bitwise reproducible regardless of compiler and optimization
+//! flags. Ticks only touch the packed integer state, subject positions are
+//! mirrored from it when the subjects are read.
+//!
+//! Subjects are re-sorted along a Z-order curve every few ticks, so subjects
+//! close in space stay close in memory. Each subject keeps the id it got
+//! when it was added, ids() maps indices to those ids.
+//!
+//! Contacts are tested along the path of each subject through the tick,
+//! not only at its end, so fast subjects cannot pass through each other.
+//! Walls reflect subjects however far they overshoot, paths are tested
+//! piece by piece between the bounces.
+//!
+//! A tick is split into substeps when fast subjects crowd, so each subject
+//! meets its neighbours one at a time. Timers and statistics stay per tick.
+//!
+//! With a scheduler, motion and contact tests run on its threads. Results
+//! do not depend on the number of threads.
+class Simulation final {
+public:
+  //! Time spent re-sorting subjects
+  struct ReorderCost final {
+    uint64_t reorders = 0u;
+    std::chrono::nanoseconds last{0};
+    std::chrono::nanoseconds total{0};
+  };
+
+public:
+  //! Starts at \p ticks, sick subjects recover after their
+  //! sickTimeRemaining elapses.
+  Simulation(const Params &params, const QRect &bounds,
+             std::shared_ptr<Subjects> subjects, uint64_t ticks = 0u);
+
+  void step();
+  void setCollisions(bool enabled);
+
+  //! Changes applied to the running epidemic, e.g. to model interventions.
+  void setRadius(float radius);
+  //! Scales every subject's speed by the ratio to the previous minimal
+  //! speed, both have to be positive.
+  void setMinimalSpeed(float minimalSpeed);
+  //! Stretches the time left until recovery of sick subjects by the ratio
+  //! to the previous sick time, later infections last \p sickTime.
+  void setSickTime(float sickTime);
+  //! Appends moving subjects.
+  void addSubjects(const Subjects &subjects);
+  //! Removes the \p number subjects added last, i.e. with the highest ids.
+  void removeSubjects(size_t number);
+  //! Zero never re-sorts subjects.
+  void setReorderInterval(uint32_t ticks) { reorderInterval_ = ticks; }
+  //! Runs on the calling thread alone without one, the scheduler has to
+  //! outlive the simulation.
+  void setScheduler(TaskScheduler *scheduler) { scheduler_ = scheduler; }
+
+  //! Writes the time left until recovery back to sick subjects.
+  void syncSickTime();
+
+  //! In fixed point mode, positions are mirrored from the integer state
+  //! first if a tick moved subjects since.
+  [[nodiscard]] const std::shared_ptr<Subjects> &subjects();
+  //! Ids of the subjects, dense in [0, number) and ordered by when the
+  //! subjects were added.
+  [[nodiscard]] const std::vector<uint32_t> &ids() const { return ids_; }
+  [[nodiscard]] const ReorderCost &reorderCost() const { return reorderCost_; }
+  [[nodiscard]] const Params &params() const { return params_; }
+  [[nodiscard]] const QRect &bounds() const { return bounds_; }
+  [[nodiscard]] uint64_t ticks() const { return timers_.now(); }
+  //! Substeps the last tick was split into.
+  [[nodiscard]] uint32_t substeps() const { return substeps_; }
+  [[nodiscard]] Statistics statistics() const;
+
+private:
+  struct Contact final {
+    uint32_t first;
+    uint32_t second;
+  };
+
+  struct FixedPoint final {
+    int32_t x;
+    int32_t y;
+  };
+
+  struct FixedMotion final {
+    int32_t x;
+    int32_t y;
+    int32_t vx;
+    int32_t vy;
+    int32_t radius;
+    //! Position at the beginning of the substep
+    FixedPoint start;
+    //! Displacement of the substep before walls reflected it
+    FixedPoint path;
+  };
+
+private:
+  //! Calls \p body(chunk, first, last) for chunks of [0, count).
+  template <typename Body> void parallelFor(size_t count, Body &&body) const;
+  //! Appends what \p collect(first, last, part) collects for each chunk of
+  //! [0, count) to \p result.
+  template <typename T, typename Collect>
+  void gather(size_t count, std::vector<std::vector<T>> &parts,
+              std::vector<T> &result, Collect &&collect);
+  //! Everybody may get sick, so buffers bounded by the population are
+  //! reserved up front and never grow while the epidemic spreads.
+  void reservePopulation();
+  void fireTimers();
+  [[nodiscard]] FixedMotion toFixedMotion(const Subject &subject) const;
+  //! Read from the integer state in fixed point mode.
+  [[nodiscard]] QPointF position(uint32_t id) const;
+  void rebuildFrozenGrid();
+  //! Pairs closer than their contact distance plus a skin are listed and
+  //! reused until a subject moved half the skin, infections and contacts
+  //! are only tested among them.
+  [[nodiscard]] float skin() const;
+  [[nodiscard]] bool neighboursValid() const { return neighboursBuilt_; }
+  void invalidateNeighbours() { neighboursBuilt_ = false; }
+  [[nodiscard]] bool movedTooFar() const;
+  //! Compared on the integer positions, \p limit is in subject units.
+  [[nodiscard]] bool movedTooFarFixed(double limit) const;
+  void buildNeighbours();
+  template <typename Update> void rescheduleTimers(Update &&update);
+  void reorder();
+  //! Moves the subject at index order[i] to index i, subjects missing from
+  //! \p order are dropped.
+  void permute(const std::vector<uint32_t> &order);
+  //! Enough substeps for the fastest subject to cover a fraction of the
+  //! mean free path in the most crowded area per substep.
+  [[nodiscard]] uint32_t chooseSubsteps();
+  void moveSubjects(uint32_t substep = 0u);
+  void moveFixedSubjects(uint32_t substep);
+  //! Whether \p a and \p b touched at some point of the substep, the
+  //! closest approach of their paths is solved for exactly. Paths bouncing
+  //! off a wall are split at the bend, located to 1/65536 of the substep.
+  [[nodiscard]] bool met(uint32_t a, uint32_t b) const;
+  //! Whether the subject hit a wall during the substep.
+  [[nodiscard]] bool bounced(uint32_t id) const;
+  //! Reverses the subject and returns it to where it started the tick.
+  void bounce(uint32_t id);
+  //! Collects healthy subjects met by sick ones.
+  void spreadInfection();
+  void infect(uint32_t id);
+  void collectContacts();
+  void resolveContacts();
+
+private:
+  Params params_;
+  QRect bounds_;
+  std::shared_ptr<Subjects> subjects_;
+  float maxRadius_ = 0.f;
+  size_t frozenNumber_ = 0u;
+  LevelGrid frozenGrid_;
+  LevelGrid grid_;
+  TimerWheel timers_;
+  std::vector<Contact> contacts_;
+  //! Pairs within the neighbour distance, at least one of them moving
+  std::vector<Contact> pairs_;
+  std::vector<uint32_t> neighbourStart_;
+  std::vector<uint32_t> neighbours_;
+  std::vector<uint32_t> cursor_;
+  //! Contact distance plus the skin or twice the path length of the tick
+  //! the neighbour lists were built at, whichever is longer
+  std::vector<float> reach_;
+  //! Positions the neighbour lists were built at
+  std::vector<QPointF> builtPos_;
+  std::vector<FixedPoint> builtFixed_;
+  //! Positions at the beginning of the substep, fixed point motion keeps
+  //! them along
+  std::vector<QPointF> startPos_;
+  //! Displacements of the substep before walls reflected them
+  std::vector<QPointF> path_;
+  bool neighboursBuilt_ = false;
+  std::vector<FixedMotion> fixed_;
+  //! Whether subject positions mirror the integer state
+  bool positionsSynced_ = true;
+  std::vector<uint32_t> sick_;
+  std::vector<uint32_t> infected_;
+  TaskScheduler *scheduler_ = nullptr;
+  //! Per chunk results
+  std::vector<std::vector<Contact>> chunkPairs_;
+  std::vector<std::vector<uint32_t>> chunkInfected_;
+  uint32_t substeps_ = 1u;
+  //! Subjects per crowding cell
+  std::vector<uint32_t> crowd_;
+  std::vector<TimerWheel::Timer> rescheduled_;
+  std::vector<uint32_t> ids_;
+  uint32_t reorderInterval_ = 0u;
+  //! The frozen prefix never moves, it is sorted once
+  bool frozenOrdered_ = false;
+  ReorderCost reorderCost_;
+  //! Reorder scratch
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> order_;
+  std::vector<uint32_t> indexOf_;
+  Subjects permuted_;
+  std::vector<FixedMotion> permutedFixed_;
+  std::vector<uint32_t> permutedIds_;
+  std::vector<QPointF> permutedStartPos_;
+  size_t recoveredNumber_ = 0u;
+  size_t infectedNumber_ = 0u;
+};
+
+} // namespace cvd
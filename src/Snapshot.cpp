@@ -0,0 +1,20 @@
+#include "Snapshot.h"
+
+namespace cvd {
+
+void Snapshot::assign(const Subjects &source, const bool pack) {
+  if (pack != compact) {
+    //! Gives the memory of the other mode back
+    Subjects{}.swap(subjects);
+    packed = CompactSubjects{};
+    compact = pack;
+  }
+  if (compact) {
+    packed.assign(source);
+  } else {
+    //! Reuses the capacity of an earlier snapshot
+    subjects = source;
+  }
+}
+
+} // namespace cvd
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "CompactSubjects.h"
+#include "Subject.h"
+
+namespace cvd {
+
+//! Subjects as the render area paints them, packed with compact snapshots.
+//! Only the storage of the current mode is kept.
+struct Snapshot final {
+  void assign(const Subjects &source, bool pack);
+
+  bool compact = false;
+  Subjects subjects;
+  CompactSubjects packed;
+};
+
+} // namespace cvd
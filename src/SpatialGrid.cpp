@@ -0,0 +1,83 @@
+#include "SpatialGrid.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace cvd {
+
+template <typename Position, typename Member>
+void SpatialGrid::index(Position &&position, const size_t count,
+                        Member &&member, const QRect &bounds,
+                        const float cellSize) {
+  assert(cellSize > 0.f);
+  bounds_ = bounds;
+  cellSize_ = cellSize;
+  columns_ = std::max(
+      1, static_cast<int>(std::ceil(static_cast<float>(bounds.width()) /
+                                    cellSize)));
+  rows_ = std::max(
+      1, static_cast<int>(std::ceil(static_cast<float>(bounds.height()) /
+                                    cellSize)));
+
+  //! Counting sort of subjects by cell
+  const auto cells = static_cast<size_t>(columns_ * rows_);
+  cellStart_.assign(cells + 1, 0u);
+  cellOfSubject_.resize(count);
+  for (auto i = size_t{0u}; i < count; ++i) {
+    const auto pos = position(member(i));
+    const auto cell = static_cast<uint32_t>(row(pos.y()) * columns_ +
+                                            column(pos.x()));
+    cellOfSubject_[i] = cell;
+    ++cellStart_[cell + 1];
+  }
+  for (auto cell = 0u; cell < cells; ++cell) {
+    cellStart_[cell + 1] += cellStart_[cell];
+  }
+
+  indices_.resize(count);
+  for (auto i = size_t{0u}; i < count; ++i) {
+    //! Use the start offsets as insertion cursors, restored below
+    indices_[cellStart_[cellOfSubject_[i]]++] = member(i);
+  }
+  for (auto cell = cells; cell > 0u; --cell) {
+    cellStart_[cell] = cellStart_[cell - 1];
+  }
+  cellStart_[0] = 0u;
+}
+
+void SpatialGrid::rebuild(const Subjects &subjects, const size_t first,
+                          const size_t last, const QRect &bounds,
+                          const float cellSize) {
+  assert(first <= last && last <= subjects.size());
+  index(
+      [&subjects](const uint32_t id) { return subjects[id].pos; },
+      last - first,
+      [first](const size_t i) { return static_cast<uint32_t>(first + i); },
+      bounds, cellSize);
+}
+
+void SpatialGrid::rebuild(const std::vector<QPointF> &positions,
+                          const std::vector<uint32_t> &members,
+                          const QRect &bounds, const float cellSize) {
+  index(
+      [&positions](const uint32_t id) { return positions[id]; },
+      members.size(), [&members](const size_t i) { return members[i]; },
+      bounds, cellSize);
+}
+
+void SpatialGrid::reserve(const size_t count) {
+  indices_.reserve(count);
+  cellOfSubject_.reserve(count);
+}
+
+int SpatialGrid::column(const double x) const {
+  const auto column = static_cast<int>((x - bounds_.left()) / cellSize_);
+  return std::clamp(column, 0, columns_ - 1);
+}
+
+int SpatialGrid::row(const double y) const {
+  const auto row = static_cast<int>((y - bounds_.top()) / cellSize_);
+  return std::clamp(row, 0, rows_ - 1);
+}
+
+} // namespace cvd
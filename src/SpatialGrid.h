@@ -0,0 +1,128 @@
+#pragma once
+
+#include <QRect>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Subject.h"
+
+namespace cvd {
+
+//! Uniform grid over subjects. Cells are stored as one flat index array
+//! with per-cell offsets, so rebuilding does not allocate once warmed up.
+class SpatialGrid final {
+public:
+  //! Indexes subjects from the [first, last) range of \p subjects.
+  void rebuild(const Subjects &subjects, size_t first, size_t last,
+               const QRect &bounds, float cellSize);
+  //! Indexes the subjects listed in \p members, \p positions holds the
+  //! position of each subject by index.
+  void rebuild(const std::vector<QPointF> &positions,
+               const std::vector<uint32_t> &members, const QRect &bounds,
+               float cellSize);
+
+  //! Visits every unordered pair of subjects sharing a cell or lying in
+  //! adjacent cells exactly once, using a half-shell stencil.
+  template <typename Visitor> void forEachPair(Visitor &&visitor) const;
+
+  //! Visits every subject from the cell containing \p pos and the cells
+  //! around it, i.e. every subject closer than one cell size.
+  template <typename Visitor>
+  void forEachNear(const QPointF &pos, Visitor &&visitor) const;
+
+  //! Visits every subject from the cells overlapping the square of half
+  //! size \p distance around \p pos.
+  template <typename Visitor>
+  void forEachWithin(const QPointF &pos, double distance,
+                     Visitor &&visitor) const;
+
+  //! Makes room for indexing up to \p count subjects without allocating.
+  void reserve(size_t count);
+
+  [[nodiscard]] float cellSize() const { return cellSize_; }
+
+private:
+  template <typename Position, typename Member>
+  void index(Position &&position, size_t count, Member &&member,
+             const QRect &bounds, float cellSize);
+  [[nodiscard]] int column(double x) const;
+  [[nodiscard]] int row(double y) const;
+
+private:
+  QRect bounds_;
+  float cellSize_ = 1.f;
+  int columns_ = 0;
+  int rows_ = 0;
+  std::vector<uint32_t> cellStart_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> cellOfSubject_;
+};
+
+template <typename Visitor>
+void SpatialGrid::forEachPair(Visitor &&visitor) const {
+  //! Forward half of the 3x3 neighbourhood, the other half is visited from
+  //! the neighbouring cells.
+  constexpr int halfShell[][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+
+  for (auto cy = 0; cy < rows_; ++cy) {
+    for (auto cx = 0; cx < columns_; ++cx) {
+      const auto cell = static_cast<size_t>(cy * columns_ + cx);
+      const auto begin = cellStart_[cell];
+      const auto end = cellStart_[cell + 1];
+      for (auto i = begin; i < end; ++i) {
+        for (auto j = i + 1; j < end; ++j) {
+          visitor(indices_[i], indices_[j]);
+        }
+      }
+
+      for (const auto &offset : halfShell) {
+        const auto nx = cx + offset[0];
+        const auto ny = cy + offset[1];
+        if (nx < 0 || nx >= columns_ || ny >= rows_) {
+          continue;
+        }
+        const auto other = static_cast<size_t>(ny * columns_ + nx);
+        for (auto i = begin; i < end; ++i) {
+          for (auto j = cellStart_[other]; j < cellStart_[other + 1]; ++j) {
+            visitor(indices_[i], indices_[j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Visitor>
+void SpatialGrid::forEachNear(const QPointF &pos, Visitor &&visitor) const {
+  const auto cx = column(pos.x());
+  const auto cy = row(pos.y());
+  for (auto ny = std::max(0, cy - 1); ny <= std::min(rows_ - 1, cy + 1);
+       ++ny) {
+    for (auto nx = std::max(0, cx - 1); nx <= std::min(columns_ - 1, cx + 1);
+         ++nx) {
+      const auto cell = static_cast<size_t>(ny * columns_ + nx);
+      for (auto i = cellStart_[cell]; i < cellStart_[cell + 1]; ++i) {
+        visitor(indices_[i]);
+      }
+    }
+  }
+}
+
+template <typename Visitor>
+void SpatialGrid::forEachWithin(const QPointF &pos, const double distance,
+                                Visitor &&visitor) const {
+  const auto lastColumn = column(pos.x() + distance);
+  const auto lastRow = row(pos.y() + distance);
+  for (auto ny = row(pos.y() - distance); ny <= lastRow; ++ny) {
+    for (auto nx = column(pos.x() - distance); nx <= lastColumn; ++nx) {
+      const auto cell = static_cast<size_t>(ny * columns_ + nx);
+      for (auto i = cellStart_[cell]; i < cellStart_[cell + 1]; ++i) {
+        visitor(indices_[i]);
+      }
+    }
+  }
+}
+
+} // namespace cvd
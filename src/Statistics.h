@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+namespace cvd {
+
+//! Population numbers after a tick.
+struct Statistics final {
+  size_t healthy;
+  size_t sick;
+  size_t recovered;
+  //! Subjects who got sick during the tick
+  size_t infected;
+};
+
+} // namespace cvd
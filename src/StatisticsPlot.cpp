@@ -0,0 +1,91 @@
+#include "StatisticsPlot.h"
+
+#include "QCustomPlot/qcustomplot.h"
+
+namespace {
+
+//! \todo: Make it parameterizable
+constexpr auto gCapacity = 30u;
+
+//! Graph data with room for the two points per tick of every tick the axis
+//! shows
+class PlotData final : public QCPGraphDataContainer {
+public:
+  PlotData() {
+    //! Seeking back in a replay keeps the room too
+    setAutoSqueeze(false);
+    mData.reserve(2 * static_cast<int>(cvd::StatisticsPlot::gMaxTicks + 1u));
+  }
+};
+
+} // namespace
+
+namespace cvd {
+
+StatisticsPlot::StatisticsPlot(QCustomPlot *const plot) {
+  plot->clearGraphs();
+  sick_ = plot->addGraph();
+  recovered_ = plot->addGraph();
+  totalSick_ = plot->addGraph();
+  capacity_ = plot->addGraph();
+  sick_->setData(QSharedPointer<QCPGraphDataContainer>{new PlotData});
+  recovered_->setData(QSharedPointer<QCPGraphDataContainer>{new PlotData});
+  sick_->setPen(QPen{Qt::red});
+  recovered_->setPen(QPen{Qt::blue});
+  totalSick_->setPen(QPen{Qt::red});
+  capacity_->setPen(QPen{QColor{60, 60, 60, 255}, 1.5f, Qt::DotLine});
+  plot->xAxis->setRange(0, gMaxTicks);
+}
+
+void StatisticsPlot::add(const Statistics &statistics) {
+  const auto sickNumber = statistics.sick;
+  //! Replayed populations do not have to match the current parameters
+  const auto total =
+      statistics.healthy + statistics.sick + statistics.recovered;
+
+  //! Past the axis the bars would not show, their buffers do not grow
+  if (ticks_ <= gMaxTicks) {
+    sick_->addData(ticks_, 0);
+    sick_->addData(ticks_, sickNumber);
+
+    const auto recoveredNumber = statistics.recovered;
+    recovered_->addData(ticks_, total);
+    recovered_->addData(ticks_, total - recoveredNumber);
+  }
+
+  {
+    //! Moved in place instead of rebuilt every tick
+    auto &line = *totalSick_->data();
+    if (line.isEmpty()) {
+      totalSick_->addData(0, sickNumber);
+      totalSick_->addData(gMaxTicks, sickNumber);
+    }
+    for (auto &point : line) {
+      point.value = static_cast<double>(sickNumber);
+    }
+  }
+
+  if (capacity_->data()->isEmpty()) {
+    capacity_->addData(0, gCapacity);
+    capacity_->addData(gMaxTicks, gCapacity);
+  }
+
+  ticks_ += 1u;
+}
+
+void StatisticsPlot::seek(const size_t tick) {
+  const auto last = static_cast<double>(tick) - 0.5;
+  sick_->data()->removeAfter(last);
+  recovered_->data()->removeAfter(last);
+  ticks_ = tick;
+}
+
+void StatisticsPlot::clear() {
+  sick_->data()->clear();
+  recovered_->data()->clear();
+  totalSick_->data()->clear();
+  capacity_->data()->clear();
+  ticks_ = 0u;
+}
+
+} // namespace cvd
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Statistics.h"
+
+class QCPGraph;
+class QCustomPlot;
+
+namespace cvd {
+
+//! Curves of a run by tick on a plot. Its time axis shows a fixed number of
+//! ticks and their points fit buffers reserved up front. Ticks past the axis
+//! are not stored, so adding a tick never allocates once both the current
+//! sick line and the capacity line are drawn.
+class StatisticsPlot final {
+public:
+  //! Ticks the time axis shows
+  static constexpr auto gMaxTicks = size_t{10000u};
+
+  //! Replaces the graphs of \p plot, which keeps owning them.
+  explicit StatisticsPlot(QCustomPlot *plot);
+
+  StatisticsPlot(const StatisticsPlot &) = delete;
+  StatisticsPlot &operator=(const StatisticsPlot &) = delete;
+
+  //! Plots the statistics of the next tick.
+  void add(const Statistics &statistics);
+  //! Makes \p tick the next one, the curves from it on are plotted again.
+  void seek(size_t tick);
+  void clear();
+
+private:
+  size_t ticks_ = 0u;
+  QCPGraph *sick_;
+  QCPGraph *recovered_;
+  QCPGraph *totalSick_;
+  QCPGraph *capacity_;
+};
+
+} // namespace cvd
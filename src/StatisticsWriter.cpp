@@ -0,0 +1,157 @@
+#include "StatisticsWriter.h"
+
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+const cvd::arrow::Names gColumnNames = {
+    "tick", "healthy", "sick", "recovered", "infected",
+};
+
+} // namespace
+
+namespace cvd {
+
+StatisticsWriter::StatisticsWriter(const QString &path, const Format format)
+    : file_{path}, format_{format}, batch_(gColumnNames.size()) {
+  if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    failed_ = true;
+    return;
+  }
+
+  if (format_ == Format::Arrow) {
+    arrow::appendFileStart(buffer_);
+    arrow::appendSchema(gColumnNames, buffer_);
+  } else {
+    for (const auto *name : gColumnNames) {
+      buffer_.append(name, static_cast<int>(std::strlen(name)));
+      buffer_.append(name == gColumnNames.back() ? '\n' : ',');
+    }
+  }
+  failed_ = file_.write(buffer_) != buffer_.size();
+
+  writer_ = std::thread{[this] { run(); }};
+}
+
+StatisticsWriter::~StatisticsWriter() { static_cast<void>(finish()); }
+
+void StatisticsWriter::append(const uint64_t tick,
+                              const Statistics &statistics) {
+  if (!writer_.joinable()) {
+    return;
+  }
+
+  const uint64_t row[] = {
+      tick,
+      statistics.healthy,
+      statistics.sick,
+      statistics.recovered,
+      statistics.infected,
+  };
+  assert(batch_.size() == std::size(row));
+  for (auto column = 0u; column < batch_.size(); ++column) {
+    batch_[column].push_back(row[column]);
+  }
+  if (batch_.front().size() >= gBatchRows) {
+    push();
+  }
+}
+
+bool StatisticsWriter::finish() {
+  if (!writer_.joinable()) {
+    return !failed_;
+  }
+  if (!batch_.front().empty()) {
+    push();
+  }
+  {
+    std::lock_guard lock{mutex_};
+    finishing_ = true;
+  }
+  condition_.notify_all();
+  writer_.join();
+
+  //! The writer thread is done with the file
+  if (format_ == Format::Arrow && !failed_) {
+    buffer_.resize(0);
+    arrow::appendFooter(gColumnNames, blocks_, buffer_);
+    failed_ = file_.write(buffer_) != buffer_.size();
+  }
+  failed_ = failed_ || !file_.flush();
+  file_.close();
+  return !failed_;
+}
+
+void StatisticsWriter::push() {
+  arrow::Columns batch;
+  {
+    std::unique_lock lock{mutex_};
+    condition_.wait(lock, [this] { return queue_.size() < gMaxQueued; });
+    if (!free_.empty()) {
+      batch = std::move(free_.back());
+      free_.pop_back();
+    }
+    queue_.push_back(std::move(batch_));
+  }
+  condition_.notify_all();
+
+  batch.resize(gColumnNames.size());
+  for (auto &column : batch) {
+    column.clear();
+  }
+  batch_ = std::move(batch);
+}
+
+void StatisticsWriter::run() {
+  for (;;) {
+    arrow::Columns batch;
+    {
+      std::unique_lock lock{mutex_};
+      condition_.wait(lock, [this] { return finishing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      batch = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    condition_.notify_all();
+
+    write(batch);
+
+    std::lock_guard lock{mutex_};
+    free_.push_back(std::move(batch));
+  }
+}
+
+void StatisticsWriter::write(const arrow::Columns &batch) {
+  if (failed_) {
+    return;
+  }
+
+  buffer_.resize(0);
+  if (format_ == Format::Arrow) {
+    blocks_.push_back(arrow::appendRecordBatch(
+        batch, static_cast<int64_t>(file_.pos()), buffer_));
+  } else {
+    writeCsv(batch);
+  }
+  failed_ = file_.write(buffer_) != buffer_.size();
+}
+
+void StatisticsWriter::writeCsv(const arrow::Columns &batch) {
+  //! Longest row: five 20 digit numbers and their separators
+  char row[5 * 21];
+  for (auto i = 0u; i < batch.front().size(); ++i) {
+    auto *end = row;
+    for (const auto &column : batch) {
+      end = std::to_chars(end, row + sizeof(row), column[i]).ptr;
+      *end++ = &column == &batch.back() ? '\n' : ',';
+    }
+    buffer_.append(row, static_cast<int>(end - row));
+  }
+}
+
+} // namespace cvd
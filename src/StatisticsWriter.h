@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arrow.h"
+#include "Statistics.h"
+
+namespace cvd {
+
+//! Streams per tick statistics into a columnar CSV or Arrow IPC file. The
+//! caller only appends rows to the current batch, formatting and writing of
+//! full batches happen on a background thread.
+class StatisticsWriter final {
+public:
+  enum class Format {
+    Csv,
+    Arrow,
+  };
+
+  StatisticsWriter(const QString &path, Format format);
+  ~StatisticsWriter();
+
+  StatisticsWriter(const StatisticsWriter &) = delete;
+  StatisticsWriter &operator=(const StatisticsWriter &) = delete;
+
+  [[nodiscard]] bool isOpen() const { return file_.isOpen(); }
+  [[nodiscard]] QString path() const { return file_.fileName(); }
+
+  void append(uint64_t tick, const Statistics &statistics);
+  //! Writes the remaining rows and, for Arrow, the footer, false if any
+  //! write failed.
+  [[nodiscard]] bool finish();
+
+private:
+  void push();
+  void run();
+  void write(const arrow::Columns &batch);
+  void writeCsv(const arrow::Columns &batch);
+
+private:
+  static constexpr auto gBatchRows = 16384u;
+  //! Batches waiting for the writer, appending blocks beyond that
+  static constexpr auto gMaxQueued = 4u;
+
+  QFile file_;
+  Format format_;
+  arrow::Columns batch_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<arrow::Columns> queue_;
+  std::vector<arrow::Columns> free_;
+  bool finishing_ = false;
+
+  //! Writer thread state
+  QByteArray buffer_;
+  std::vector<arrow::Block> blocks_;
+  bool failed_ = false;
+
+  std::thread writer_;
+};
+
+} // namespace cvd
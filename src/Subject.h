@@ -18,6 +18,8 @@ struct Subject final {
   float speed;
   float radius;
   Status status;
+  //! Sick time left when the subject got sick, the countdown itself is
+  //! scheduled by the simulation.
   float sickTimeRemaining;
   bool freezed;
 
@@ -0,0 +1,146 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+//! Chunks per thread of a loop, enough for stealing to even out uneven
+//! chunks without paying for many tiny ones
+constexpr auto gChunksPerThread = size_t{8u};
+//! Initial ring capacity of a deque
+constexpr auto gMinimalRing = size_t{16u};
+
+} // namespace
+
+namespace cvd {
+
+TaskScheduler::TaskScheduler(const unsigned threads) {
+  for (auto worker = 0u; worker < threads; ++worker) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (auto worker = size_t{0u}; worker < threads; ++worker) {
+    workers_.emplace_back([this, worker] { work(worker); });
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard lock{sleepMutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t TaskScheduler::chunks(const size_t count, const size_t grain) const {
+  if (workers_.empty() || count == 0u) {
+    return 1u;
+  }
+  const auto grained = (count + std::max(grain, size_t{1u}) - 1u) /
+                       std::max(grain, size_t{1u});
+  //! The calling thread works along
+  return std::min(grained, gChunksPerThread * (workers_.size() + 1u));
+}
+
+void TaskScheduler::run(Job &job) {
+  //! Loops started at once begin at different deques
+  const auto first = nextQueue_.fetch_add(1u, std::memory_order_relaxed);
+  //! Counted first, so a chunk run right away never takes the count below
+  //! zero
+  queued_.fetch_add(job.chunks, std::memory_order_release);
+  for (auto chunk = size_t{0u}; chunk < job.chunks; ++chunk) {
+    auto &queue = *queues_[(first + chunk) % queues_.size()];
+    std::lock_guard lock{queue.mutex};
+    queue.push(Task{&job, chunk});
+  }
+  {
+    std::lock_guard lock{sleepMutex_};
+  }
+  wake_.notify_all();
+
+  //! The caller owns no deque, it only steals until its loop is done
+  while (job.remaining.load(std::memory_order_acquire) > 0u) {
+    if (!runOne(queues_.size())) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+bool TaskScheduler::runOne(const size_t worker) {
+  auto found = false;
+  Task task{};
+  if (worker < queues_.size()) {
+    auto &queue = *queues_[worker];
+    std::lock_guard lock{queue.mutex};
+    found = queue.popNewest(task);
+  }
+  for (auto offset = size_t{1u}; !found && offset <= queues_.size();
+       ++offset) {
+    auto &queue = *queues_[(worker + offset) % queues_.size()];
+    std::lock_guard lock{queue.mutex};
+    found = queue.popOldest(task);
+  }
+  if (!found) {
+    return false;
+  }
+
+  queued_.fetch_sub(1u, std::memory_order_relaxed);
+  auto &job = *task.job;
+  const AllocationCounter::Attach attach{job.counter};
+  job.run(job.body, task.chunk, job.count * task.chunk / job.chunks,
+          job.count * (task.chunk + 1u) / job.chunks);
+  //! The caller may return and destroy the job right after this
+  job.remaining.fetch_sub(1u, std::memory_order_acq_rel);
+  return true;
+}
+
+void TaskScheduler::Queue::push(const Task &task) {
+  if (size == ring.size()) {
+    std::vector<Task> grown(std::max(2u * ring.size(), gMinimalRing));
+    for (auto i = size_t{0u}; i < size; ++i) {
+      grown[i] = ring[(head + i) % ring.size()];
+    }
+    ring.swap(grown);
+    head = 0u;
+  }
+  ring[(head + size) % ring.size()] = task;
+  ++size;
+}
+
+bool TaskScheduler::Queue::popNewest(Task &task) {
+  if (size == 0u) {
+    return false;
+  }
+  --size;
+  task = ring[(head + size) % ring.size()];
+  return true;
+}
+
+bool TaskScheduler::Queue::popOldest(Task &task) {
+  if (size == 0u) {
+    return false;
+  }
+  task = ring[head];
+  head = (head + 1u) % ring.size();
+  --size;
+  return true;
+}
+
+void TaskScheduler::work(const size_t worker) {
+  for (;;) {
+    if (runOne(worker)) {
+      continue;
+    }
+    std::unique_lock lock{sleepMutex_};
+    wake_.wait(lock, [this] {
+      return stopping_ || queued_.load(std::memory_order_acquire) > 0u;
+    });
+    if (stopping_ && queued_.load(std::memory_order_acquire) == 0u) {
+      return;
+    }
+  }
+}
+
+} // namespace cvd
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+namespace cvd {
+
+//! Runs loops over index ranges on a pool of worker threads. A loop is cut
+//! into chunks dealt out to per-worker deques, a worker runs its own chunks
+//! newest first and steals the oldest chunks of the others once it runs
+//! dry, so clustered work, e.g. a crowd of subjects in one corner, does not
+//! leave workers idle. The calling thread steals chunks of its loop too.
+class TaskScheduler final {
+public:
+  //! Zero threads runs every loop on the calling thread.
+  explicit TaskScheduler(unsigned threads);
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler &) = delete;
+  TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+  [[nodiscard]] unsigned threads() const {
+    return static_cast<unsigned>(workers_.size());
+  }
+
+  //! Number of chunks parallelFor cuts \p count indices into, for callers
+  //! collecting results per chunk.
+  [[nodiscard]] size_t chunks(size_t count, size_t grain) const;
+
+  //! Calls \p body(chunk, first, last) for consecutive ranges of at least
+  //! \p grain indices covering [0, count) and returns once all are done.
+  //! Loops may be started from several threads at once.
+  template <typename Body>
+  void parallelFor(size_t count, size_t grain, Body &&body);
+
+private:
+  struct Job final {
+    void (*run)(const void *body, size_t chunk, size_t first, size_t last);
+    const void *body;
+    size_t count;
+    size_t chunks;
+    std::atomic<size_t> remaining;
+    //! Allocations of the chunks count for the caller
+    AllocationCounter *counter;
+  };
+
+  struct Task final {
+    Job *job;
+    size_t chunk;
+  };
+
+  //! Ring of tasks, only grown when more are queued than ever before, so
+  //! dealing out a loop does not allocate
+  struct Queue final {
+    void push(const Task &task);
+    //! The owner takes the newest task, thieves take the oldest one.
+    [[nodiscard]] bool popNewest(Task &task);
+    [[nodiscard]] bool popOldest(Task &task);
+
+    std::mutex mutex;
+    std::vector<Task> ring;
+    size_t head = 0u;
+    size_t size = 0u;
+  };
+
+private:
+  void run(Job &job);
+  //! Runs a chunk from the deque of \p worker, or stolen from another one,
+  //! false if there was none.
+  bool runOne(size_t worker);
+  void work(size_t worker);
+
+private:
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<size_t> queued_{0u};
+  //! Deque the next loop starts dealing chunks at
+  std::atomic<size_t> nextQueue_{0u};
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+template <typename Body>
+void TaskScheduler::parallelFor(const size_t count, const size_t grain,
+                                Body &&body) {
+  const auto chunks = this->chunks(count, grain);
+  if (chunks <= 1u) {
+    if (count > 0u) {
+      body(size_t{0u}, size_t{0u}, count);
+    }
+    return;
+  }
+
+  using Callable = std::remove_reference_t<Body>;
+  Job job{[](const void *callable, const size_t chunk, const size_t first,
+             const size_t last) {
+            (*static_cast<const Callable *>(callable))(chunk, first, last);
+          },
+          &body, count, chunks, {chunks}, AllocationCounter::current()};
+  run(job);
+}
+
+} // namespace cvd
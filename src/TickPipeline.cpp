@@ -0,0 +1,136 @@
+#include "TickPipeline.h"
+
+#include <cassert>
+
+namespace {
+
+//! Long frames publish snapshots about that often, so they show progress
+constexpr auto gPublishInterval = std::chrono::milliseconds{10u};
+
+} // namespace
+
+namespace cvd {
+
+TickPipeline::TickPipeline() {
+  worker_ = std::thread{[this] { run(); }};
+}
+
+TickPipeline::~TickPipeline() {
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  condition_.notify_all();
+  //! A frame in flight is finished first
+  worker_.join();
+}
+
+void TickPipeline::submit(const Request &request) {
+  assert(!inFlight_ && request.simulation && request.snapshots);
+  //! The other buffer may still be read
+  filling_ = 1u - filling_;
+  {
+    std::lock_guard lock{mutex_};
+    pending_ = request;
+    slot_ = filling_;
+  }
+  inFlight_ = true;
+  condition_.notify_all();
+}
+
+const TickPipeline::Frame *TickPipeline::take() {
+  std::lock_guard lock{mutex_};
+  if (!done_) {
+    return nullptr;
+  }
+  inFlight_ = false;
+  done_ = false;
+  return &frames_[filling_];
+}
+
+const TickPipeline::Frame *TickPipeline::wait() {
+  if (!inFlight_) {
+    return nullptr;
+  }
+  std::unique_lock lock{mutex_};
+  condition_.wait(lock, [this] { return done_; });
+  inFlight_ = false;
+  done_ = false;
+  return &frames_[filling_];
+}
+
+void TickPipeline::run() {
+  for (;;) {
+    Request request;
+    size_t slot = 0u;
+    {
+      std::unique_lock lock{mutex_};
+      condition_.wait(lock, [this] { return stopping_ || pending_; });
+      if (!pending_) {
+        return;
+      }
+      request = *pending_;
+      pending_.reset();
+      slot = slot_;
+    }
+
+    simulate(request, frames_[slot]);
+    {
+      std::lock_guard lock{mutex_};
+      done_ = true;
+    }
+    condition_.notify_all();
+  }
+}
+
+void TickPipeline::simulate(const Request &request, Frame &frame) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  auto published = start;
+  auto &simulation = *request.simulation;
+  //! Keeps the capacity of the statistics
+  frame.statistics.clear();
+  frame.flatTicks = request.flatTicks;
+  frame.running = true;
+  auto lastSick = request.lastSick;
+  const auto publish = [&request, &simulation] {
+    if (request.compact) {
+      //! Packed snapshots carry the sick time left
+      simulation.syncSickTime();
+    }
+    request.snapshots->back().assign(*simulation.subjects(), request.compact);
+    request.snapshots->publish();
+  };
+  for (;;) {
+    simulation.step();
+    if (request.recorder) {
+      request.recorder->record(simulation.ticks(), *simulation.subjects(),
+                               simulation.ids());
+    }
+    const auto statistics = simulation.statistics();
+    const auto flat = lastSick && *lastSick == statistics.sick;
+    frame.flatTicks = flat ? frame.flatTicks + 1u : 0u;
+    lastSick = statistics.sick;
+    frame.statistics.push_back(statistics);
+
+    const auto idle = statistics.sick == 0u;
+    frame.running = !(idle && request.stopWhenHealthy) &&
+                    !(request.flatTicksLimit > 0u &&
+                      frame.flatTicks >= request.flatTicksLimit);
+    const auto now = Clock::now();
+    if (!frame.running || frame.statistics.size() >= request.maxTicks ||
+        now - start >= request.budget) {
+      break;
+    }
+    if (now - published >= gPublishInterval) {
+      publish();
+      published = now;
+    }
+  }
+
+  publish();
+  frame.ticks = simulation.ticks();
+  frame.reorderCost = simulation.reorderCost();
+}
+
+} // namespace cvd
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "Statistics.h"
+#include "Subject.h"
+#include "TrajectoryRecorder.h"
+#include "TripleBuffer.h"
+
+namespace cvd {
+
+//! Simulates the ticks of a frame on a worker thread, so the next frame is
+//! simulated while the window exports, plots and paints the previous one.
+//! A frame hands over the statistics of its ticks, snapshots of the
+//! subjects are published on the way, after the last tick at least. While
+//! a frame is in flight only the worker touches the simulation, the
+//! recorder and the writing side of the snapshots.
+//!
+//! Frames are written to two recycled buffers in turn.
+class TickPipeline final {
+public:
+  struct Request final {
+    Simulation *simulation;
+    //! Records every tick if given
+    TrajectoryRecorder *recorder;
+    TripleBuffer<Snapshot> *snapshots;
+    //! Packs the snapshots into compact storage
+    bool compact;
+    //! A frame runs at least one tick and ends at whichever limit comes
+    //! first
+    uint64_t maxTicks;
+    std::chrono::steady_clock::duration budget;
+    bool stopWhenHealthy;
+    //! Zero never stops on a flat sick curve
+    size_t flatTicksLimit;
+    //! Flat ticks so far and the sick number of the last tick, if any
+    size_t flatTicks;
+    std::optional<size_t> lastSick;
+  };
+
+  struct Frame final {
+    std::vector<Statistics> statistics;
+    //! Tick of the last statistics
+    uint64_t ticks;
+    size_t flatTicks;
+    //! False once the run should stop, the frame ends with that tick
+    bool running;
+    Simulation::ReorderCost reorderCost;
+  };
+
+public:
+  TickPipeline();
+  ~TickPipeline();
+
+  TickPipeline(const TickPipeline &) = delete;
+  TickPipeline &operator=(const TickPipeline &) = delete;
+
+  //! Starts a frame, the previous one has to be taken.
+  void submit(const Request &request);
+  [[nodiscard]] bool inFlight() const { return inFlight_; }
+  //! The frame in flight if it is done, null otherwise. A frame stays valid
+  //! until the submit after the next one.
+  [[nodiscard]] const Frame *take();
+  //! Waits for the frame in flight, null if there is none.
+  [[nodiscard]] const Frame *wait();
+
+private:
+  void run();
+  void simulate(const Request &request, Frame &frame);
+
+private:
+  //! Only used by the submitting thread
+  bool inFlight_ = false;
+  size_t filling_ = 0u;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::optional<Request> pending_;
+  //! Buffer of the frame in flight
+  size_t slot_ = 0u;
+  bool done_ = false;
+  bool stopping_ = false;
+  std::array<Frame, 2u> frames_{};
+
+  std::thread worker_;
+};
+
+} // namespace cvd
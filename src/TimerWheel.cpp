@@ -0,0 +1,80 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace cvd {
+
+void TimerWheel::reset(const uint64_t now) {
+  for (auto &level : levels_) {
+    level.fill(Slot{});
+  }
+  //! Keeps the capacity of the pool
+  nodes_.clear();
+  free_ = gNone;
+  now_ = now;
+  size_ = 0u;
+}
+
+void TimerWheel::schedule(const uint64_t due, const uint32_t subject,
+                          const Event event) {
+  const auto timer = Timer{std::max(due, now_ + 1u), subject, event};
+  auto node = free_;
+  if (node != gNone) {
+    free_ = nodes_[node].next;
+    nodes_[node].timer = timer;
+  } else {
+    assert(nodes_.size() < gNone);
+    node = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node{timer, gNone});
+  }
+  insert(node);
+  ++size_;
+}
+
+void TimerWheel::insert(const uint32_t node) {
+  const auto &timer = nodes_[node].timer;
+  assert(timer.due >= now_);
+  nodes_[node].next = gNone;
+  const auto append = [this, node](Slot &slot) {
+    if (slot.tail == gNone) {
+      slot.head = node;
+    } else {
+      nodes_[slot.tail].next = node;
+    }
+    slot.tail = node;
+  };
+  const auto delta = timer.due - now_;
+  for (auto level = 0u; level < gLevels; ++level) {
+    const auto shift = gSlotBits * level;
+    const auto span = uint64_t{1} << (shift + gSlotBits);
+    if (delta < span) {
+      append(levels_[level][(timer.due >> shift) & (gSlots - 1u)]);
+      return;
+    }
+  }
+
+  //! Beyond the wheel range, park in the farthest slot of the top level,
+  //! the timer is re-inserted with its real due tick when cascaded.
+  const auto shift = gSlotBits * (gLevels - 1u);
+  const auto farthest = now_ + (uint64_t{1} << (gSlotBits * gLevels)) - 1u;
+  append(levels_[gLevels - 1u][(farthest >> shift) & (gSlots - 1u)]);
+}
+
+void TimerWheel::cascade(const unsigned level) {
+  const auto shift = gSlotBits * level;
+  auto node = detach(levels_[level][(now_ >> shift) & (gSlots - 1u)]);
+  while (node != gNone) {
+    const auto next = nodes_[node].next;
+    insert(node);
+    node = next;
+  }
+}
+
+uint32_t TimerWheel::detach(Slot &slot) {
+  const auto head = slot.head;
+  slot = Slot{};
+  return head;
+}
+
+} // namespace cvd
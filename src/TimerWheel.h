@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace cvd {
+
+//! Hierarchical timer wheel for subject transitions happening at a known
+//! tick. Each level has 64 slots and covers 64 times the range of the level
+//! below, timers are cascaded down as their slot comes close. Scheduling and
+//! firing are O(1) per timer, advancing by a tick does not depend on the
+//! number of pending timers.
+//!
+//! Slots are lists linked through a pool of timer nodes, fired nodes are
+//! reused, so scheduling only allocates when more timers are pending than
+//! ever before.
+class TimerWheel final {
+public:
+  enum class Event : uint8_t {
+    Recovery,
+  };
+
+  struct Timer final {
+    uint64_t due;
+    uint32_t subject;
+    Event event;
+  };
+
+public:
+  void reset(uint64_t now = 0u);
+  //! Makes room for \p timers pending timers.
+  void reserve(size_t timers) { nodes_.reserve(timers); }
+  //! Timers due at the current tick or earlier fire on the next one.
+  void schedule(uint64_t due, uint32_t subject, Event event);
+
+  //! Moves to the next tick and visits every timer due at it.
+  template <typename Visitor> void advance(Visitor &&visitor);
+
+  //! Visits every pending timer, in no particular order.
+  template <typename Visitor> void forEach(Visitor &&visitor) const;
+
+  [[nodiscard]] uint64_t now() const { return now_; }
+  [[nodiscard]] size_t size() const { return size_; }
+
+private:
+  static constexpr auto gSlotBits = 6u;
+  static constexpr auto gSlots = 1u << gSlotBits;
+  static constexpr auto gLevels = 4u;
+
+  static constexpr auto gNone = std::numeric_limits<uint32_t>::max();
+
+  struct Node final {
+    Timer timer;
+    uint32_t next;
+  };
+
+  //! Timers in the order they were inserted
+  struct Slot final {
+    uint32_t head = gNone;
+    uint32_t tail = gNone;
+  };
+  using Level = std::array<Slot, gSlots>;
+
+private:
+  //! Links node \p node into the slot of its timer.
+  void insert(uint32_t node);
+  void cascade(unsigned level);
+  //! Empties the slot and returns the first of its linked nodes.
+  [[nodiscard]] static uint32_t detach(Slot &slot);
+
+private:
+  std::array<Level, gLevels> levels_;
+  std::vector<Node> nodes_;
+  //! Nodes free for reuse, linked like slots
+  uint32_t free_ = gNone;
+  uint64_t now_ = 0u;
+  size_t size_ = 0u;
+};
+
+template <typename Visitor> void TimerWheel::advance(Visitor &&visitor) {
+  ++now_;
+  for (auto level = gLevels - 1u; level > 0u; --level) {
+    //! A level is cascaded when all levels below it wrap around
+    const auto mask = (uint64_t{1} << (gSlotBits * level)) - 1u;
+    if ((now_ & mask) == 0u) {
+      cascade(level);
+    }
+  }
+
+  //! Visitor may schedule new timers, detach due ones first
+  auto node = detach(levels_[0][now_ & (gSlots - 1u)]);
+  while (node != gNone) {
+    //! Copied out, scheduling may reuse the node or grow the pool
+    const auto timer = nodes_[node].timer;
+    const auto next = nodes_[node].next;
+    nodes_[node].next = free_;
+    free_ = node;
+    --size_;
+    visitor(timer);
+    node = next;
+  }
+}
+
+template <typename Visitor> void TimerWheel::forEach(Visitor &&visitor) const {
+  for (const auto &level : levels_) {
+    for (const auto &slot : level) {
+      for (auto node = slot.head; node != gNone; node = nodes_[node].next) {
+        visitor(nodes_[node].timer);
+      }
+    }
+  }
+}
+
+} // namespace cvd
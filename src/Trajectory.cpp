@@ -0,0 +1,255 @@
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+template <typename T> void append(QByteArray &payload, const T &value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  payload.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+void appendArray(QByteArray &payload, const std::vector<T> &values) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  payload.append(reinterpret_cast<const char *>(values.data()),
+                 static_cast<int>(values.size() * sizeof(T)));
+}
+
+void appendVarint(QByteArray &payload, uint32_t value) {
+  while (value >= 0x80u) {
+    payload.append(static_cast<char>((value & 0x7fu) | 0x80u));
+    value >>= 7u;
+  }
+  payload.append(static_cast<char>(value));
+}
+
+[[nodiscard]] uint32_t zigzag(const int32_t value) {
+  return (static_cast<uint32_t>(value) << 1u) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+//! Sequential reader over an uncompressed payload
+class Cursor final {
+public:
+  explicit Cursor(const QByteArray &payload)
+      : data_{reinterpret_cast<const uint8_t *>(payload.constData())},
+        end_{data_ + payload.size()} {}
+
+  template <typename T> [[nodiscard]] bool read(T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (static_cast<size_t>(end_ - data_) < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, data_, sizeof(T));
+    data_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T> [[nodiscard]] bool readArray(std::vector<T> &values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto bytes = values.size() * sizeof(T);
+    if (static_cast<size_t>(end_ - data_) < bytes) {
+      return false;
+    }
+    std::memcpy(values.data(), data_, bytes);
+    data_ += bytes;
+    return true;
+  }
+
+  [[nodiscard]] bool readVarint(uint32_t &value) {
+    value = 0u;
+    for (auto shift = 0u; shift < 35u; shift += 7u) {
+      if (data_ == end_) {
+        return false;
+      }
+      const auto byte = *data_++;
+      value |= static_cast<uint32_t>(byte & 0x7fu) << shift;
+      if ((byte & 0x80u) == 0u) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  [[nodiscard]] bool atEnd() const { return data_ == end_; }
+
+private:
+  const uint8_t *data_;
+  const uint8_t *end_;
+};
+
+[[nodiscard]] int32_t unzigzag(const uint32_t value) {
+  return static_cast<int32_t>(value >> 1u) ^ -static_cast<int32_t>(value & 1u);
+}
+
+[[nodiscard]] uint16_t quantize(const double value, const double origin,
+                                const double extent) {
+  const auto units =
+      std::lround((value - origin) / extent * cvd::trajectory::gPositionUnits);
+  return static_cast<uint16_t>(std::clamp(units, 0l, 65535l));
+}
+
+} // namespace
+
+namespace cvd::trajectory {
+
+void quantize(const uint64_t tick, const Subjects &subjects,
+              const QRect &bounds, Frame &frame,
+              const std::vector<uint32_t> &ids) {
+  const auto size = subjects.size();
+  assert(ids.empty() || ids.size() == size);
+  frame.tick = tick;
+  frame.x.resize(size);
+  frame.y.resize(size);
+  frame.status.resize(size);
+  frame.radius.resize(size);
+  for (auto i = 0u; i < size; ++i) {
+    const auto &subject = subjects[i];
+    const auto id = ids.empty() ? i : ids[i];
+    frame.x[id] = ::quantize(subject.pos.x(), bounds.left(), bounds.width());
+    frame.y[id] = ::quantize(subject.pos.y(), bounds.top(), bounds.height());
+    frame.status[id] = static_cast<uint8_t>(subject.status);
+    frame.radius[id] = subject.radius;
+  }
+}
+
+void encodeKeyframe(const Frame &frame, Motion &motion, QByteArray &payload) {
+  append(payload, static_cast<uint32_t>(frame.x.size()));
+  //! Column after column, compresses better than records
+  appendArray(payload, frame.x);
+  appendArray(payload, frame.y);
+  appendArray(payload, frame.status);
+  appendArray(payload, frame.radius);
+
+  motion.dx.assign(frame.x.size(), 0);
+  motion.dy.assign(frame.y.size(), 0);
+}
+
+void encodeDelta(const Frame &frame, const Frame &previous, Motion &motion,
+                 QByteArray &payload) {
+  const auto size = frame.x.size();
+  assert(size == previous.x.size() && size == motion.dx.size());
+  const auto encode = [&payload, size](const std::vector<uint16_t> &current,
+                                       const std::vector<uint16_t> &last,
+                                       std::vector<int32_t> &displacement) {
+    for (auto i = 0u; i < size; ++i) {
+      const auto delta =
+          static_cast<int32_t>(current[i]) - static_cast<int32_t>(last[i]);
+      appendVarint(payload, zigzag(delta - displacement[i]));
+      displacement[i] = delta;
+    }
+  };
+  encode(frame.x, previous.x, motion.dx);
+  encode(frame.y, previous.y, motion.dy);
+
+  auto changes = 0u;
+  for (auto i = 0u; i < size; ++i) {
+    changes += frame.status[i] != previous.status[i] ? 1u : 0u;
+  }
+  appendVarint(payload, changes);
+  //! Subject ids are stored as gaps to the previous changed one
+  auto last = 0u;
+  for (auto i = 0u; i < size; ++i) {
+    if (frame.status[i] != previous.status[i]) {
+      appendVarint(payload, i - last);
+      append(payload, frame.status[i]);
+      last = i;
+    }
+  }
+}
+
+bool decodeKeyframe(const QByteArray &payload, Frame &frame, Motion &motion) {
+  Cursor cursor{payload};
+  auto size = 0u;
+  if (!cursor.read(size)) {
+    return false;
+  }
+  frame.x.resize(size);
+  frame.y.resize(size);
+  frame.status.resize(size);
+  frame.radius.resize(size);
+  if (!cursor.readArray(frame.x) || !cursor.readArray(frame.y) ||
+      !cursor.readArray(frame.status) || !cursor.readArray(frame.radius)) {
+    return false;
+  }
+
+  motion.dx.assign(size, 0);
+  motion.dy.assign(size, 0);
+  return cursor.atEnd();
+}
+
+bool decodeDelta(const QByteArray &payload, Frame &frame, Motion &motion) {
+  const auto size = frame.x.size();
+  if (motion.dx.size() != size) {
+    return false;
+  }
+
+  Cursor cursor{payload};
+  const auto decode = [&cursor, size](std::vector<uint16_t> &current,
+                                      std::vector<int32_t> &displacement) {
+    for (auto i = 0u; i < size; ++i) {
+      auto value = 0u;
+      if (!cursor.readVarint(value)) {
+        return false;
+      }
+      displacement[i] += unzigzag(value);
+      current[i] = static_cast<uint16_t>(current[i] + displacement[i]);
+    }
+    return true;
+  };
+  if (!decode(frame.x, motion.dx) || !decode(frame.y, motion.dy)) {
+    return false;
+  }
+
+  auto changes = 0u;
+  if (!cursor.readVarint(changes)) {
+    return false;
+  }
+  auto id = 0u;
+  for (auto change = 0u; change < changes; ++change) {
+    auto gap = 0u;
+    auto status = uint8_t{0};
+    if (!cursor.readVarint(gap) || !cursor.read(status)) {
+      return false;
+    }
+    id += gap;
+    if (id >= size) {
+      return false;
+    }
+    frame.status[id] = status;
+  }
+  return cursor.atEnd();
+}
+
+void dequantize(const Frame &frame, const QRect &bounds, Subjects &subjects) {
+  const auto scale = [](const uint16_t value, const double origin,
+                        const double extent) {
+    return origin + static_cast<double>(value) / gPositionUnits * extent;
+  };
+
+  subjects.clear();
+  subjects.reserve(frame.x.size());
+  for (auto i = 0u; i < frame.x.size(); ++i) {
+    const auto status = std::min(
+        frame.status[i], static_cast<uint8_t>(Subject::Status::Recovered));
+    subjects.push_back(Subject{
+        QPointF{
+            scale(frame.x[i], bounds.left(), bounds.width()),
+            scale(frame.y[i], bounds.top(), bounds.height()),
+        },
+        QVector2D{},
+        0.f,
+        frame.radius[i],
+        static_cast<Subject::Status>(status),
+        -1.f,
+        false,
+    });
+  }
+}
+
+} // namespace cvd::trajectory
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QByteArray>
+#include <QRect>
+
+#include <cstdint>
+#include <vector>
+
+#include "Subject.h"
+
+namespace cvd {
+
+//! Recorded trajectory file layout.
+//!
+//! Header, then one block per recorded tick: a block header with the tick
+//! and frame kind, so blocks can be indexed without decompressing them,
+//! followed by the qCompress'ed frame. Keyframes hold quantized positions,
+//! statuses and radii of every subject. Delta frames hold zigzag varints of
+//! the change of each subject's per-tick displacement, which is zero for
+//! anyone moving straight, and a list of status changes. A finished file
+//! ends with the keyframe index and a trailer pointing at it.
+namespace trajectory {
+
+constexpr char gMagic[8] = {'C', 'V', 'D', 'T', 'R', 'A', 'J', '\0'};
+constexpr char gIndexMagic[8] = {'C', 'V', 'D', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t gVersion = 2u;
+constexpr auto gPositionUnits = 65535.;
+
+struct Header final {
+  char magic[8];
+  uint32_t version;
+  uint32_t keyframeInterval;
+  int32_t bounds[4];
+};
+
+enum class FrameKind : uint8_t {
+  Key,
+  Delta,
+};
+
+struct BlockHeader final {
+  uint32_t size;
+  FrameKind kind;
+  uint8_t padding[3];
+  uint64_t tick;
+};
+
+struct IndexEntry final {
+  uint64_t tick;
+  uint64_t offset;
+};
+
+struct Trailer final {
+  uint64_t indexOffset;
+  char magic[8];
+};
+
+//! Subjects at a tick with positions quantized to the bounds.
+struct Frame final {
+  uint64_t tick = 0u;
+  std::vector<uint16_t> x;
+  std::vector<uint16_t> y;
+  std::vector<uint8_t> status;
+  std::vector<float> radius;
+};
+
+//! Subject i is stored at ids[i], in index order if \p ids is empty.
+void quantize(uint64_t tick, const Subjects &subjects, const QRect &bounds,
+              Frame &frame, const std::vector<uint32_t> &ids = {});
+
+//! Per-subject displacement during the last tick, reset by keyframes.
+struct Motion final {
+  std::vector<int32_t> dx;
+  std::vector<int32_t> dy;
+};
+
+//! Append the uncompressed frame to \p payload. Delta frames are encoded
+//! against \p previous which must have the same number of subjects, and
+//! update \p motion with the displacements of this tick.
+void encodeKeyframe(const Frame &frame, Motion &motion, QByteArray &payload);
+void encodeDelta(const Frame &frame, const Frame &previous, Motion &motion,
+                 QByteArray &payload);
+
+//! Inverse of the encoders, a delta is applied to \p frame in place. Return
+//! false on a malformed payload. The tick comes from the block header.
+[[nodiscard]] bool decodeKeyframe(const QByteArray &payload, Frame &frame,
+                                  Motion &motion);
+[[nodiscard]] bool decodeDelta(const QByteArray &payload, Frame &frame,
+                               Motion &motion);
+
+//! Subjects at the frame positions, motion is not recorded.
+void dequantize(const Frame &frame, const QRect &bounds, Subjects &subjects);
+
+} // namespace trajectory
+} // namespace cvd
@@ -0,0 +1,206 @@
+#include "TrajectoryPlayer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+//! Subjects counted per parallel chunk at least
+constexpr auto gChunkGrain = size_t{16384u};
+
+} // namespace
+
+namespace cvd {
+
+TrajectoryPlayer::TrajectoryPlayer(const QString &path) : file_{path} {
+  if (!file_.open(QIODevice::ReadOnly) ||
+      file_.size() < static_cast<qint64>(sizeof(trajectory::Header))) {
+    return;
+  }
+  size_ = static_cast<uint64_t>(file_.size());
+  data_ = file_.map(0, file_.size());
+  if (!data_) {
+    return;
+  }
+
+  trajectory::Header header;
+  std::memcpy(&header, data_, sizeof(header));
+  if (std::memcmp(header.magic, trajectory::gMagic, sizeof(header.magic)) !=
+          0 ||
+      header.version != trajectory::gVersion) {
+    return;
+  }
+  bounds_ = QRect{header.bounds[0], header.bounds[1], header.bounds[2],
+                  header.bounds[3]};
+
+  //! An interrupted recording has no index, rebuild it from block headers
+  if (!loadIndex()) {
+    scanBlocks();
+  }
+  if (keyframes_.empty()) {
+    return;
+  }
+
+  //! Last tick is in the blocks after the last keyframe
+  trajectory::BlockHeader block;
+  for (auto offset = keyframes_.back().offset; readHeader(offset, block);
+       offset += sizeof(block) + block.size) {
+    lastTick_ = block.tick;
+  }
+
+  offset_ = keyframes_.front().offset;
+  loaded_ = next();
+}
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+  if (data_) {
+    file_.unmap(const_cast<uchar *>(data_));
+  }
+}
+
+bool TrajectoryPlayer::seek(const uint64_t tick) {
+  if (!loaded_) {
+    return false;
+  }
+  const auto keyframe = std::upper_bound(
+      keyframes_.begin(), keyframes_.end(), tick,
+      [](const uint64_t value, const trajectory::IndexEntry &entry) {
+        return value < entry.tick;
+      });
+  offset_ = keyframe == keyframes_.begin() ? keyframes_.front().offset
+                                           : std::prev(keyframe)->offset;
+  if (!next()) {
+    return false;
+  }
+
+  trajectory::BlockHeader block;
+  while (readHeader(offset_, block) && block.tick <= tick) {
+    if (!next()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TrajectoryPlayer::next() {
+  trajectory::BlockHeader block;
+  if (!readHeader(offset_, block)) {
+    return false;
+  }
+  const auto payload = qUncompress(data_ + offset_ + sizeof(block),
+                                   static_cast<int>(block.size));
+  const auto decoded =
+      block.kind == trajectory::FrameKind::Key
+          ? trajectory::decodeKeyframe(payload, frame_, motion_)
+          : trajectory::decodeDelta(payload, frame_, motion_);
+  if (!decoded) {
+    return false;
+  }
+
+  frame_.tick = block.tick;
+  offset_ += sizeof(block) + block.size;
+  dirty_ = true;
+  return true;
+}
+
+const std::shared_ptr<Subjects> &TrajectoryPlayer::subjects() {
+  if (dirty_) {
+    trajectory::dequantize(frame_, bounds_, *subjects_);
+    dirty_ = false;
+  }
+  return subjects_;
+}
+
+Statistics TrajectoryPlayer::statistics() const {
+  const auto count = [this](const size_t first, const size_t last) {
+    Statistics result{0u, 0u, 0u, 0u};
+    for (auto i = first; i < last; ++i) {
+      switch (static_cast<Subject::Status>(frame_.status[i])) {
+      case Subject::Status::Healthy:
+        ++result.healthy;
+        break;
+      case Subject::Status::Sick:
+        ++result.sick;
+        break;
+      case Subject::Status::Recovered:
+        ++result.recovered;
+        break;
+      default:
+        break;
+      }
+    }
+    return result;
+  };
+  const auto size = frame_.status.size();
+  if (scheduler_ == nullptr) {
+    return count(0u, size);
+  }
+
+  std::vector<Statistics> parts(scheduler_->chunks(size, gChunkGrain),
+                                Statistics{0u, 0u, 0u, 0u});
+  const auto countChunk = [&parts, &count](const size_t chunk,
+                                           const size_t first,
+                                           const size_t last) {
+    parts[chunk] = count(first, last);
+  };
+  scheduler_->parallelFor(size, gChunkGrain, countChunk);
+  Statistics result{0u, 0u, 0u, 0u};
+  for (const auto &part : parts) {
+    result.healthy += part.healthy;
+    result.sick += part.sick;
+    result.recovered += part.recovered;
+  }
+  return result;
+}
+
+bool TrajectoryPlayer::readHeader(const uint64_t offset,
+                                  trajectory::BlockHeader &header) const {
+  if (offset + sizeof(header) > dataEnd_) {
+    return false;
+  }
+  std::memcpy(&header, data_ + offset, sizeof(header));
+  return offset + sizeof(header) + header.size <= dataEnd_;
+}
+
+bool TrajectoryPlayer::loadIndex() {
+  trajectory::Trailer trailer;
+  if (size_ < sizeof(trajectory::Header) + sizeof(trailer) + sizeof(uint64_t)) {
+    return false;
+  }
+  std::memcpy(&trailer, data_ + size_ - sizeof(trailer), sizeof(trailer));
+  if (std::memcmp(trailer.magic, trajectory::gIndexMagic,
+                  sizeof(trailer.magic)) != 0 ||
+      trailer.indexOffset < sizeof(trajectory::Header) ||
+      trailer.indexOffset + sizeof(uint64_t) > size_ - sizeof(trailer)) {
+    return false;
+  }
+
+  auto count = uint64_t{0};
+  std::memcpy(&count, data_ + trailer.indexOffset, sizeof(count));
+  const auto entries = trailer.indexOffset + sizeof(count);
+  if (count > (size_ - sizeof(trailer) - entries) /
+                  sizeof(trajectory::IndexEntry)) {
+    return false;
+  }
+  keyframes_.resize(count);
+  std::memcpy(keyframes_.data(), data_ + entries,
+              count * sizeof(trajectory::IndexEntry));
+  dataEnd_ = trailer.indexOffset;
+  return true;
+}
+
+void TrajectoryPlayer::scanBlocks() {
+  keyframes_.clear();
+  dataEnd_ = size_;
+  trajectory::BlockHeader block;
+  auto offset = static_cast<uint64_t>(sizeof(trajectory::Header));
+  for (; readHeader(offset, block); offset += sizeof(block) + block.size) {
+    if (block.kind == trajectory::FrameKind::Key) {
+      keyframes_.push_back(trajectory::IndexEntry{block.tick, offset});
+    }
+  }
+  //! Drop a partially written last block
+  dataEnd_ = offset;
+}
+
+} // namespace cvd
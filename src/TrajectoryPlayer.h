@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QFile>
+#include <QRect>
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Statistics.h"
+#include "Subject.h"
+#include "TaskScheduler.h"
+#include "Trajectory.h"
+
+namespace cvd {
+
+//! Plays back a recorded trajectory file without the simulation. The file
+//! is memory mapped, seeking decodes the closest keyframe before the target
+//! and the few deltas after it.
+class TrajectoryPlayer final {
+public:
+  explicit TrajectoryPlayer(const QString &path);
+  ~TrajectoryPlayer();
+
+  TrajectoryPlayer(const TrajectoryPlayer &) = delete;
+  TrajectoryPlayer &operator=(const TrajectoryPlayer &) = delete;
+
+  [[nodiscard]] bool isOpen() const { return loaded_; }
+  [[nodiscard]] const QRect &bounds() const { return bounds_; }
+  [[nodiscard]] uint64_t firstTick() const { return keyframes_.front().tick; }
+  [[nodiscard]] uint64_t lastTick() const { return lastTick_; }
+  [[nodiscard]] uint64_t tick() const { return frame_.tick; }
+  //! Statistics are counted on its threads, it has to outlive the player.
+  void setScheduler(TaskScheduler *scheduler) { scheduler_ = scheduler; }
+
+  //! Moves to the last frame recorded at or before \p tick.
+  bool seek(uint64_t tick);
+  //! Moves to the next recorded frame, false at the end of the recording.
+  bool next();
+
+  //! Subjects and statistics of the current frame, the subjects are only
+  //! restored from the frame on demand. Infections are not recorded.
+  [[nodiscard]] const std::shared_ptr<Subjects> &subjects();
+  [[nodiscard]] Statistics statistics() const;
+
+private:
+  [[nodiscard]] bool readHeader(uint64_t offset,
+                                trajectory::BlockHeader &header) const;
+  [[nodiscard]] bool loadIndex();
+  void scanBlocks();
+
+private:
+  QFile file_;
+  const uchar *data_ = nullptr;
+  uint64_t size_ = 0u;
+  uint64_t dataEnd_ = 0u;
+  QRect bounds_;
+  std::vector<trajectory::IndexEntry> keyframes_;
+  uint64_t lastTick_ = 0u;
+
+  uint64_t offset_ = 0u;
+  bool loaded_ = false;
+  trajectory::Frame frame_;
+  trajectory::Motion motion_;
+  bool dirty_ = true;
+  std::shared_ptr<Subjects> subjects_ = std::make_shared<Subjects>();
+  TaskScheduler *scheduler_ = nullptr;
+};
+
+} // namespace cvd
@@ -0,0 +1,170 @@
+#include "TrajectoryRecorder.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+//! Fastest zlib level, keeps the writer ahead of the simulation
+constexpr auto gCompressionLevel = 1;
+
+} // namespace
+
+namespace cvd {
+
+TrajectoryRecorder::TrajectoryRecorder(const QString &path,
+                                       const QRect &bounds,
+                                       const uint32_t keyframeInterval)
+    : file_{path}, bounds_{bounds}, keyframeInterval_{keyframeInterval} {
+  assert(keyframeInterval_ > 0u);
+  if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    failed_ = true;
+    return;
+  }
+
+  trajectory::Header header{};
+  std::memcpy(header.magic, trajectory::gMagic, sizeof(header.magic));
+  header.version = trajectory::gVersion;
+  header.keyframeInterval = keyframeInterval_;
+  header.bounds[0] = bounds.x();
+  header.bounds[1] = bounds.y();
+  header.bounds[2] = bounds.width();
+  header.bounds[3] = bounds.height();
+  failed_ = file_.write(reinterpret_cast<const char *>(&header),
+                        sizeof(header)) != sizeof(header);
+
+  writer_ = std::thread{[this] { run(); }};
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() { static_cast<void>(finish()); }
+
+void TrajectoryRecorder::record(const uint64_t tick, const Subjects &subjects,
+                                const std::vector<uint32_t> &ids) {
+  if (!writer_.joinable()) {
+    return;
+  }
+
+  trajectory::Frame frame;
+  auto first = false;
+  {
+    std::unique_lock lock{mutex_};
+    condition_.wait(lock, [this] {
+      return queued_ < gMaxQueued && (!free_.empty() || frames_ < gMaxFrames);
+    });
+    if (!free_.empty()) {
+      frame = std::move(free_.back());
+      free_.pop_back();
+    } else {
+      first = frames_ == 0u;
+      ++frames_;
+    }
+  }
+
+  trajectory::quantize(tick, subjects, bounds_, frame, ids);
+
+  {
+    std::lock_guard lock{mutex_};
+    if (first) {
+      //! Hands out the whole pool sized like the first frame, a frame made
+      //! only once the writer falls behind would grow deep into the run
+      free_.reserve(gMaxFrames);
+      free_.assign(gMaxFrames - 1u, frame);
+      frames_ = gMaxFrames;
+    }
+    queue_[(queueHead_ + queued_) % gMaxQueued] = std::move(frame);
+    ++queued_;
+  }
+  condition_.notify_all();
+}
+
+bool TrajectoryRecorder::finish() {
+  if (!writer_.joinable()) {
+    return !failed_;
+  }
+  {
+    std::lock_guard lock{mutex_};
+    finishing_ = true;
+  }
+  condition_.notify_all();
+  writer_.join();
+
+  //! Index and trailer, the writer thread is done with the file
+  if (!failed_) {
+    const auto writeAll = [this](const void *data, const qint64 size) {
+      return file_.write(static_cast<const char *>(data), size) == size;
+    };
+    const auto indexOffset = static_cast<uint64_t>(file_.pos());
+    const auto count = static_cast<uint64_t>(index_.size());
+    trajectory::Trailer trailer{};
+    trailer.indexOffset = indexOffset;
+    std::memcpy(trailer.magic, trajectory::gIndexMagic,
+                sizeof(trailer.magic));
+    failed_ = !writeAll(&count, sizeof(count)) ||
+              !writeAll(index_.data(),
+                        static_cast<qint64>(index_.size() *
+                                            sizeof(trajectory::IndexEntry))) ||
+              !writeAll(&trailer, sizeof(trailer)) || !file_.flush();
+  }
+  file_.close();
+  return !failed_;
+}
+
+void TrajectoryRecorder::run() {
+  for (;;) {
+    trajectory::Frame frame;
+    {
+      std::unique_lock lock{mutex_};
+      condition_.wait(lock, [this] { return finishing_ || queued_ > 0u; });
+      if (queued_ == 0u) {
+        return;
+      }
+      frame = std::move(queue_[queueHead_]);
+      queueHead_ = (queueHead_ + 1u) % gMaxQueued;
+      --queued_;
+    }
+    condition_.notify_all();
+
+    write(frame);
+
+    //! The previous frame is only needed for the next delta, recycle it
+    std::swap(previous_, frame);
+    {
+      std::lock_guard lock{mutex_};
+      free_.push_back(std::move(frame));
+    }
+    condition_.notify_all();
+  }
+}
+
+void TrajectoryRecorder::write(const trajectory::Frame &frame) {
+  if (failed_) {
+    return;
+  }
+
+  payload_.resize(0);
+  //! Population and radius changes are only representable by a keyframe
+  const auto keyframe = index_.empty() || sinceKeyframe_ >= keyframeInterval_ ||
+                        frame.x.size() != previous_.x.size() ||
+                        frame.radius != previous_.radius;
+  if (keyframe) {
+    index_.push_back(trajectory::IndexEntry{
+        frame.tick, static_cast<uint64_t>(file_.pos())});
+    trajectory::encodeKeyframe(frame, motion_, payload_);
+    sinceKeyframe_ = 1u;
+  } else {
+    trajectory::encodeDelta(frame, previous_, motion_, payload_);
+    ++sinceKeyframe_;
+  }
+
+  const auto block = qCompress(payload_, gCompressionLevel);
+  trajectory::BlockHeader header{};
+  header.size = static_cast<uint32_t>(block.size());
+  header.kind = keyframe ? trajectory::FrameKind::Key
+                         : trajectory::FrameKind::Delta;
+  header.tick = frame.tick;
+  failed_ = file_.write(reinterpret_cast<const char *>(&header),
+                        sizeof(header)) != sizeof(header) ||
+            file_.write(block) != block.size();
+}
+
+} // namespace cvd
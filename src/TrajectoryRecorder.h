@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QFile>
+#include <QRect>
+#include <QString>
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Subject.h"
+#include "Trajectory.h"
+
+namespace cvd {
+
+//! Appends subject positions and statuses per tick to a trajectory file.
+//! The caller only quantizes subjects into a recycled frame, encoding,
+//! compression and writing happen on a background thread.
+class TrajectoryRecorder final {
+public:
+  TrajectoryRecorder(const QString &path, const QRect &bounds,
+                     uint32_t keyframeInterval = 100u);
+  ~TrajectoryRecorder();
+
+  TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+  TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+  [[nodiscard]] bool isOpen() const { return file_.isOpen(); }
+  [[nodiscard]] QString path() const { return file_.fileName(); }
+
+  //! Subjects are recorded in the order of \p ids if given, so deltas
+  //! follow each subject when the simulation re-sorts them.
+  void record(uint64_t tick, const Subjects &subjects,
+              const std::vector<uint32_t> &ids = {});
+  //! Writes the remaining frames and the keyframe index, false if any
+  //! write failed.
+  [[nodiscard]] bool finish();
+
+private:
+  void run();
+  void write(const trajectory::Frame &frame);
+
+private:
+  //! Frames waiting for the writer, the recording blocks beyond that
+  static constexpr auto gMaxQueued = 16u;
+  //! Frames ever handed out, besides the queued ones one is being written
+  //! and one is kept for the next delta. The recording waits for one of
+  //! them to be recycled instead of allocating more.
+  static constexpr auto gMaxFrames = gMaxQueued + 2u;
+
+  QFile file_;
+  QRect bounds_;
+  uint32_t keyframeInterval_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  //! Ring of queued frames
+  std::array<trajectory::Frame, gMaxQueued> queue_;
+  size_t queueHead_ = 0u;
+  size_t queued_ = 0u;
+  std::vector<trajectory::Frame> free_;
+  size_t frames_ = 0u;
+  bool finishing_ = false;
+
+  //! Writer thread state
+  trajectory::Frame previous_;
+  trajectory::Motion motion_;
+  uint32_t sinceKeyframe_ = 0u;
+  QByteArray payload_;
+  std::vector<trajectory::IndexEntry> index_;
+  bool failed_ = false;
+
+  std::thread writer_;
+};
+
+} // namespace cvd
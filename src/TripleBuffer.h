@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace cvd {
+
+//! Hands snapshots from one writer to one reader without locks. The writer
+//! fills the back buffer and publishes it in exchange for the middle one,
+//! the reader swaps the middle buffer in whenever it holds a newer
+//! snapshot. Neither side ever waits for the other, the writer may publish
+//! at any rate and the reader always gets the newest published snapshot,
+//! older ones it missed are overwritten. Buffers are reused, so once they
+//! have grown, e.g. vectors, publishing does not allocate.
+//!
+//! The writer or the reader may move to another thread when the previous
+//! one is done with the buffer and synchronized with the new one.
+template <typename T> class TripleBuffer final {
+public:
+  //! Filled by the writer, holds a snapshot published earlier.
+  [[nodiscard]] T &back() { return buffers_[back_]; }
+  void publish();
+
+  //! Whether a snapshot newer than the one read last was published.
+  [[nodiscard]] bool fresh() const {
+    return (middle_.load(std::memory_order_acquire) & gFresh) != 0u;
+  }
+  //! The newest published snapshot, valid until the next read.
+  [[nodiscard]] const T &read();
+
+private:
+  //! Set on the middle index until the reader took the snapshot
+  static constexpr uint8_t gFresh = 4u;
+  static constexpr uint8_t gIndex = 3u;
+
+  std::array<T, 3> buffers_{};
+  std::atomic<uint8_t> middle_{1u};
+  uint8_t back_ = 0u;
+  uint8_t front_ = 2u;
+};
+
+template <typename T> void TripleBuffer<T>::publish() {
+  //! Releases the snapshot and acquires what the reader left in the old
+  //! middle buffer
+  const auto middle = middle_.exchange(static_cast<uint8_t>(back_ | gFresh),
+                                       std::memory_order_acq_rel);
+  back_ = static_cast<uint8_t>(middle & gIndex);
+}
+
+template <typename T> const T &TripleBuffer<T>::read() {
+  if (fresh()) {
+    const auto middle = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = static_cast<uint8_t>(middle & gIndex);
+  }
+  return buffers_[front_];
+}
+
+} // namespace cvd
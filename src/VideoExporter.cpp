@@ -0,0 +1,245 @@
+#include "VideoExporter.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QPainter>
+
+#include <algorithm>
+#include <cassert>
+
+#include "RenderArea.h"
+
+namespace {
+
+//! One frame per tick, the speed the window runs at
+constexpr auto gFrameRate = 100;
+//! Frames queued or being encoded per encoder thread
+constexpr auto gFramesPerThread = 2u;
+//! Light compression, PNG encoding dominates the export otherwise
+constexpr auto gPngQuality = 80;
+//! Row pairs converted to YUV per parallel chunk at least
+constexpr auto gRowPairGrain = size_t{16u};
+
+//! Chroma offset plus rounding, in the fixed point of 2x2 block sums
+constexpr auto gChromaBias = (128 << 10) + (1 << 9);
+
+//! 4:2:0 chroma subsampling needs even frame dimensions
+[[nodiscard]] int evenCeil(const int value) { return (value + 1) / 2 * 2; }
+
+[[nodiscard]] uint8_t clampByte(const int value) {
+  return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+} // namespace
+
+namespace cvd {
+
+VideoExporter::VideoExporter(const QString &path, const Format format,
+                             const QRect &bounds, const Style &style,
+                             const unsigned threads,
+                             TaskScheduler *const scheduler)
+    : path_{path}, format_{format}, bounds_{bounds}, style_{style},
+      size_{evenCeil(bounds.width()), evenCeil(bounds.height())},
+      file_{path}, maxQueued_{std::max(threads, 1u) * gFramesPerThread},
+      scheduler_{scheduler} {
+  if (format_ == Format::Png) {
+    open_ = QFileInfo{path_}.dir().exists();
+  } else if (file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    const auto header = QString{"YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n"}
+                            .arg(size_.width())
+                            .arg(size_.height())
+                            .arg(gFrameRate)
+                            .toLatin1();
+    open_ = file_.write(header) == header.size();
+  }
+  if (!open_) {
+    return;
+  }
+
+  for (auto i = 0u; i < std::max(threads, 1u); ++i) {
+    workers_.emplace_back([this] { run(); });
+  }
+}
+
+VideoExporter::~VideoExporter() { static_cast<void>(finish()); }
+
+void VideoExporter::addFrame(const Subjects &subjects) {
+  if (workers_.empty()) {
+    return;
+  }
+
+  Subjects copy;
+  {
+    std::unique_lock lock{mutex_};
+    condition_.wait(lock,
+                    [this] { return frames_ - written_ < maxQueued_; });
+    if (!free_.empty()) {
+      copy = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+
+  //! Reuses the capacity of a recycled frame
+  copy.assign(subjects.begin(), subjects.end());
+
+  {
+    std::lock_guard lock{mutex_};
+    queue_.push_back(Job{frames_++, std::move(copy)});
+  }
+  condition_.notify_all();
+}
+
+bool VideoExporter::finish() {
+  if (workers_.empty()) {
+    return open_ && !failed_;
+  }
+  {
+    std::lock_guard lock{mutex_};
+    finishing_ = true;
+  }
+  condition_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  assert(pending_.empty());
+
+  if (file_.isOpen()) {
+    failed_ = failed_ || !file_.flush();
+    file_.close();
+  }
+  return !failed_;
+}
+
+void VideoExporter::run() {
+  QImage image{size_, QImage::Format_RGB32};
+  QByteArray encoded;
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock lock{mutex_};
+      condition_.wait(lock, [this] { return finishing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    render(job.subjects, image);
+    if (format_ == Format::Png) {
+      const auto written = writePng(job.frame, image);
+      std::lock_guard lock{mutex_};
+      failed_ = failed_ || !written;
+      ++written_;
+    } else {
+      encodeY4m(image, encoded);
+      writeInOrder(job.frame, encoded);
+    }
+
+    {
+      std::lock_guard lock{mutex_};
+      free_.push_back(std::move(job.subjects));
+    }
+    condition_.notify_all();
+  }
+}
+
+void VideoExporter::render(const Subjects &subjects, QImage &image) const {
+  image.fill(style_.background);
+  QPainter painter{&image};
+  RenderArea::paint(painter, bounds_, QPen{style_.edges}, subjects);
+}
+
+bool VideoExporter::writePng(const uint64_t frame, const QImage &image) const {
+  const QFileInfo info{path_};
+  const auto name = QString{"%1/%2_%3.png"}
+                        .arg(info.absolutePath())
+                        .arg(info.completeBaseName())
+                        .arg(frame, 6, 10, QChar{'0'});
+  return image.save(name, "PNG", gPngQuality);
+}
+
+void VideoExporter::encodeY4m(const QImage &image, QByteArray &encoded) const {
+  //! Full range BT.601 in 8 bit fixed point, as implied by C420jpeg
+  static constexpr char frameHeader[] = "FRAME\n";
+  const auto width = image.width();
+  const auto height = image.height();
+  const auto lumaSize = width * height;
+  const auto chromaSize = lumaSize / 4;
+  encoded.resize(static_cast<int>(sizeof(frameHeader) - 1) + lumaSize +
+                 2 * chromaSize);
+  std::copy(frameHeader, frameHeader + sizeof(frameHeader) - 1,
+            encoded.data());
+  auto *luma = reinterpret_cast<uint8_t *>(encoded.data()) +
+               sizeof(frameHeader) - 1;
+  auto *cb = luma + lumaSize;
+  auto *cr = cb + chromaSize;
+
+  //! Rows are converted in pairs, each pair gives one chroma row
+  const auto convert = [&](size_t, const size_t first, const size_t last) {
+    for (auto pair = first; pair < last; ++pair) {
+      const auto y = static_cast<int>(2u * pair);
+      const QRgb *rows[] = {
+          reinterpret_cast<const QRgb *>(image.constScanLine(y)),
+          reinterpret_cast<const QRgb *>(image.constScanLine(y + 1)),
+      };
+      for (auto x = 0; x < width; x += 2) {
+        auto red = 0;
+        auto green = 0;
+        auto blue = 0;
+        for (auto row = 0; row < 2; ++row) {
+          for (auto column = 0; column < 2; ++column) {
+            const auto pixel = rows[row][x + column];
+            const auto r = qRed(pixel);
+            const auto g = qGreen(pixel);
+            const auto b = qBlue(pixel);
+            luma[(y + row) * width + x + column] =
+                static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+            red += r;
+            green += g;
+            blue += b;
+          }
+        }
+        //! Chroma of the 2x2 block average
+        const auto chroma = (y / 2) * (width / 2) + x / 2;
+        cb[chroma] = clampByte(
+            (-43 * red - 85 * green + 128 * blue + gChromaBias) >> 10);
+        cr[chroma] = clampByte(
+            (128 * red - 107 * green - 21 * blue + gChromaBias) >> 10);
+      }
+    }
+  };
+  const auto pairs = static_cast<size_t>(height / 2);
+  if (scheduler_ != nullptr) {
+    scheduler_->parallelFor(pairs, gRowPairGrain, convert);
+  } else {
+    convert(0u, 0u, pairs);
+  }
+}
+
+void VideoExporter::writeInOrder(const uint64_t frame, QByteArray &encoded) {
+  std::unique_lock lock{mutex_};
+  pending_.emplace(frame, std::move(encoded));
+  encoded = QByteArray{};
+  //! Whoever completes the next frame in line writes it and any frames
+  //! after it, other workers keep encoding meanwhile.
+  if (writing_) {
+    return;
+  }
+  writing_ = true;
+  while (!pending_.empty() && pending_.begin()->first == nextFrame_) {
+    auto block = std::move(pending_.begin()->second);
+    pending_.erase(pending_.begin());
+    lock.unlock();
+    const auto written = file_.write(block) == block.size();
+    lock.lock();
+    failed_ = failed_ || !written;
+    ++nextFrame_;
+    ++written_;
+    condition_.notify_all();
+  }
+  writing_ = false;
+}
+
+} // namespace cvd
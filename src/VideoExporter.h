@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QByteArray>
+#include <QColor>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QString>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Subject.h"
+#include "TaskScheduler.h"
+
+namespace cvd {
+
+//! Renders subjects offscreen and encodes the frames as a PNG sequence or
+//! an uncompressed YUV4MPEG2 stream. Rendering and encoding run on a pool
+//! of threads, the caller only copies the subjects of each frame.
+class VideoExporter final {
+public:
+  enum class Format {
+    Png,
+    Y4m,
+  };
+
+  struct Style final {
+    QColor background;
+    QColor edges;
+  };
+
+  //! PNG frames are written next to \p path, with the frame number
+  //! appended to its base name. Frames are converted to YUV on the threads
+  //! of \p scheduler, if any, which has to outlive the exporter.
+  VideoExporter(const QString &path, Format format, const QRect &bounds,
+                const Style &style, unsigned threads,
+                TaskScheduler *scheduler = nullptr);
+  ~VideoExporter();
+
+  VideoExporter(const VideoExporter &) = delete;
+  VideoExporter &operator=(const VideoExporter &) = delete;
+
+  [[nodiscard]] bool isOpen() const { return open_; }
+
+  void addFrame(const Subjects &subjects);
+  //! Waits for every frame to be written, false if any write failed.
+  [[nodiscard]] bool finish();
+
+private:
+  struct Job final {
+    uint64_t frame;
+    Subjects subjects;
+  };
+
+  void run();
+  void render(const Subjects &subjects, QImage &image) const;
+  [[nodiscard]] bool writePng(uint64_t frame, const QImage &image) const;
+  void encodeY4m(const QImage &image, QByteArray &encoded) const;
+  void writeInOrder(uint64_t frame, QByteArray &encoded);
+
+private:
+  QString path_;
+  Format format_;
+  QRect bounds_;
+  Style style_;
+  QSize size_;
+  QFile file_;
+  bool open_ = false;
+  size_t maxQueued_;
+  TaskScheduler *scheduler_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<Job> queue_;
+  std::vector<Subjects> free_;
+  uint64_t frames_ = 0u;
+  uint64_t written_ = 0u;
+  bool finishing_ = false;
+  bool failed_ = false;
+
+  //! Encoded Y4M frames completed out of order, waiting for their turn
+  std::map<uint64_t, QByteArray> pending_;
+  uint64_t nextFrame_ = 0u;
+  bool writing_ = false;
+
+  std::vector<std::thread> workers_;
+};
+
+} // namespace cvd
@@ -0,0 +1,155 @@
+#include <QApplication>
+#include <QImage>
+#include <QPainter>
+
+#include "AllocationCounter.h"
+#include "QCustomPlot/qcustomplot.h"
+#include "RenderArea.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "StatisticsPlot.h"
+#include "TaskScheduler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+namespace {
+
+constexpr auto gNumber = size_t{5000u};
+constexpr auto gSide = 1000;
+constexpr auto gSick = size_t{10u};
+constexpr auto gSickTime = 300.f;
+//! Every that many subjects is frozen
+constexpr auto gFrozenEvery = size_t{5u};
+constexpr auto gReorderInterval = uint32_t{50u};
+//! The epidemic is over by then, and buffers grown along with the pairs of
+//! the moving crowd
+constexpr auto gWarmUpTicks = 1500;
+constexpr auto gCountedTicks = 1000;
+//! Frames of the window take several ticks, only the last one is painted
+constexpr auto gPaintInterval = 50u;
+//! The counted ticks cross the end of the plot axis
+constexpr auto gPlotStart =
+    cvd::StatisticsPlot::gMaxTicks - gWarmUpTicks - gCountedTicks / 2;
+
+static_assert(cvd::AllocationCounter::enabled(),
+              "The test needs the counting malloc");
+
+[[nodiscard]] cvd::Subjects makeSubjects() {
+  std::mt19937 generator{5u};
+  std::uniform_real_distribution<> position{5., gSide - 5.};
+  std::uniform_real_distribution<> unit{-1., 1.};
+  cvd::Subjects subjects;
+  subjects.reserve(gNumber);
+  for (auto i = size_t{0u}; i < gNumber; ++i) {
+    const auto x = position(generator);
+    const auto y = position(generator);
+    const auto direction =
+        QVector2D{static_cast<float>(unit(generator)),
+                  static_cast<float>(unit(generator))}.normalized();
+    const auto speed = 1.f + static_cast<float>(std::abs(unit(generator)));
+    const auto sick = i < gSick;
+    subjects.push_back(cvd::Subject{
+        QPointF{x, y},
+        direction,
+        speed,
+        2.f,
+        sick ? cvd::Subject::Status::Sick : cvd::Subject::Status::Healthy,
+        sick ? gSickTime : -1.f,
+        i % gFrozenEvery == 0u,
+    });
+  }
+  return subjects;
+}
+
+//! What the window does with a tick: plots it and now and then paints both
+//! kinds of snapshots of it, offscreen.
+class Frontend final {
+public:
+  Frontend()
+      : plots_{&plot_}, image_{gSide, gSide, QImage::Format_RGB32},
+        painter_{&image_}, edgePen_{Qt::darkGray} {
+    plots_.seek(gPlotStart);
+  }
+
+  void show(cvd::Simulation &simulation) {
+    plots_.add(simulation.statistics());
+    if (simulation.ticks() % gPaintInterval != 0u) {
+      return;
+    }
+    full_.assign(*simulation.subjects(), false);
+    packed_.assign(*simulation.subjects(), true);
+    const auto edges = QRect{0, 0, gSide, gSide};
+    cvd::RenderArea::paint(painter_, edges, edgePen_, full_.subjects);
+    cvd::RenderArea::paint(painter_, edges, edgePen_, packed_.packed);
+  }
+
+private:
+  QCustomPlot plot_;
+  cvd::StatisticsPlot plots_;
+  QImage image_;
+  QPainter painter_;
+  QPen edgePen_;
+  cvd::Snapshot full_;
+  cvd::Snapshot packed_;
+};
+
+//! Whether a simulation that settled ticks, plotted and painted without
+//! allocating.
+[[nodiscard]] bool runsSteady(const bool fixedPoint, const unsigned threads) {
+  const cvd::Params params{gNumber, 0.f,  2.f,        gSickTime, 1.f,
+                           0.2f,    true, fixedPoint, false,     false};
+  cvd::TaskScheduler scheduler{threads};
+  cvd::Simulation simulation{params, QRect{0, 0, gSide, gSide},
+                             std::make_shared<cvd::Subjects>(makeSubjects())};
+  simulation.setScheduler(&scheduler);
+  simulation.setReorderInterval(gReorderInterval);
+  Frontend frontend;
+
+  for (auto tick = 0; tick < gWarmUpTicks; ++tick) {
+    simulation.step();
+    frontend.show(simulation);
+  }
+  if (simulation.statistics().sick != 0u) {
+    std::fprintf(stderr, "fixed point %d, %u threads: still spreading\n",
+                 fixedPoint, threads);
+    return false;
+  }
+
+  auto steady = true;
+  for (auto tick = 0; tick < gCountedTicks; ++tick) {
+    const cvd::AllocationCounter counter;
+    simulation.step();
+    frontend.show(simulation);
+    if (counter.count() > 0u) {
+      std::fprintf(stderr,
+                   "fixed point %d, %u threads: tick %llu allocated %llu "
+                   "times\n",
+                   fixedPoint, threads,
+                   static_cast<unsigned long long>(simulation.ticks()),
+                   static_cast<unsigned long long>(counter.count()));
+      steady = false;
+    }
+  }
+  return steady;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  //! The plot is a widget, it needs no screen
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication application{argc, argv};
+
+  auto steady = true;
+  for (const auto fixedPoint : {false, true}) {
+    for (const auto threads : {0u, 3u}) {
+      steady = runsSteady(fixedPoint, threads) && steady;
+    }
+  }
+  return steady ? EXIT_SUCCESS : EXIT_FAILURE;
+}